@@ -0,0 +1,97 @@
+#pragma once
+#ifndef ALIGNEDALLOCATOR_H
+
+#define ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+
+/** Standard library allocator returning memory aligned to Alignment bytes
+ *
+ * Used for the lightcurve columns so every column starts on a cache line
+ * and the vector loops over them never split a load. The memory comes from
+ * operator new, with the start of the block kept just before the aligned
+ * address, so anything hooking operator new sees the columns too.
+ */
+template <typename T, std::size_t Alignment>
+class AlignedAllocator
+{
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef const T *const_pointer;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef AlignedAllocator<U, Alignment> other;
+        };
+
+        AlignedAllocator() {}
+        AlignedAllocator(const AlignedAllocator &) {}
+        template <typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+
+        pointer allocate(size_type n, const void * = 0)
+        {
+            if (n == 0)
+                return 0;
+
+            if (n > max_size())
+                throw std::bad_alloc();
+
+            char *block = static_cast<char*>(::operator new(n * sizeof(T) + Overhead));
+            const std::size_t start = reinterpret_cast<std::size_t>(block + sizeof(void*));
+            char *memory = block + sizeof(void*) + (Alignment - start % Alignment) % Alignment;
+            reinterpret_cast<void**>(memory)[-1] = block;
+
+            return reinterpret_cast<pointer>(memory);
+        }
+
+        void deallocate(pointer p, size_type)
+        {
+            if (p)
+                ::operator delete(reinterpret_cast<void**>(p)[-1]);
+        }
+
+        size_type max_size() const
+        {
+            return (static_cast<size_type>(-1) - Overhead) / sizeof(T);
+        }
+
+        void construct(pointer p, const T &val)
+        {
+            new (static_cast<void*>(p)) T(val);
+        }
+
+        void destroy(pointer p)
+        {
+            p->~T();
+        }
+
+    private:
+        /** Room for the block start and the alignment padding */
+        static const std::size_t Overhead = sizeof(void*) + Alignment - 1;
+};
+
+template <typename T, typename U, std::size_t Alignment>
+inline bool operator==(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &)
+{
+    return true;
+}
+
+template <typename T, typename U, std::size_t Alignment>
+inline bool operator!=(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &)
+{
+    return false;
+}
+
+
+#endif /* end of include guard: ALIGNEDALLOCATOR_H */
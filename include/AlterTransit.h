@@ -17,6 +17,13 @@
  * */
 Lightcurve RemoveTransit(Lightcurve &data, Lightcurve &model);
 
+/** RemoveTransit writing into an existing lightcurve
+ *
+ * The output columns are reused so nothing is allocated once output has
+ * the size of data. output may be data itself.
+ */
+void RemoveTransit(const Lightcurve &data, const Lightcurve &model, Lightcurve &output);
+
 /** Function to add a transit from a lightcurve
  *
  * @param[in] data Input lightcurve
@@ -26,9 +33,30 @@ Lightcurve RemoveTransit(Lightcurve &data, Lightcurve &model);
 
 Lightcurve AddTransit(Lightcurve &data, Lightcurve &model);
 
+/** AddTransit writing into an existing lightcurve, see RemoveTransit */
+void AddTransit(const Lightcurve &data, const Lightcurve &model, Lightcurve &output);
+
+/** Function to remove one transit and add another in a single pass
+ *
+ * Gives the same result as RemoveTransit(data, subModel) followed by
+ * AddTransit on the result folded on the addModel period and epoch,
+ * but the data mean is only computed once and there is no intermediate
+ * lightcurve.
+ *
+ * @param[in] data Input lightcurve, folded on its own period and epoch for the subtraction
+ *
+ * @param[in] subModel Model lightcurve to subtract
+ *
+ * @param[in] addModel Model lightcurve to add
+ */
+Lightcurve ReplaceTransit(Lightcurve &data, Lightcurve &subModel, Lightcurve &addModel);
+
+/** ReplaceTransit writing into an existing lightcurve, see RemoveTransit */
+void ReplaceTransit(const Lightcurve &data, const Lightcurve &subModel, const Lightcurve &addModel, Lightcurve &output);
+
 /** Function to perform an addition and a subtraction
  *
- * \deprecated Function does just call RemoveTransit then AddTransit 
+ * \deprecated Function does just call ReplaceTransit (or RemoveTransit)
  * but the function requires many more parameters and is not always used
  * so both sub-functions are used 
  */
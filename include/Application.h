@@ -7,6 +7,13 @@
 #include <memory>
 #include <CCfits/CCfits>
 #include "Lightcurve.h"
+#include "ModelCache.h"
+#include "Manifest.h"
+#include "ObjectIdIndex.h"
+#include "Overlay.h"
+#include "FileGrowth.h"
+
+class ScratchArenas;
 
 /** \mainpage
  *
@@ -82,6 +89,35 @@
  * 	files. The program first subtracts the -s/--submodel transit and then for each file in the list,
  * 	a new lightcurve is inserted into the file after the original data set.
  *
+ * 	\li Inject into many hosts at once
+ *
+ * 	Instead of -s/--submodel and -a/--addmodels a -m/--manifest file lists one host per line as
+ * 	its submodel and list of configuration files. The file is copied once with room for every
+ * 	synthetic and the hosts are processed in the order they appear in the file.
+ *
+ * 	\li Write an overlay instead of a copy
+ *
+ * 	With -O/--overlay the source file is left untouched and the -o/--output file only holds,
+ * 	for each synthetic, its host row, its FAKE_* parameters and its flux inside the removed
+ * 	and injected transits. OverlayReader rebuilds the other frames from the source and the
+ * 	noise seed.
+ *
+ * 	\li Append to an existing file
+ *
+ * 	With --append the -o/--output file from an earlier run is grown in place rather than the
+ * 	input being copied again, and with --inplace the input file itself is grown. A journal
+ * 	next to the file lets an interrupted append be rolled back, which happens automatically
+ * 	on the next append to the same file. A copy made with --reserve N has N empty rows for
+ * 	later appends to fill; an append which would instead grow an HDU before the last one
+ * 	past its padding is refused, as that rewrites the rest of the file. The number of
+ * 	synthetics so far is kept as NSYNTH in the primary header so each run gets new noise
+ * 	streams. A file which already holds synthetics keeps its NOISSEED, so -S/--seed may
+ * 	only be given if it matches.
+ *
+ * 	The models are generated in parallel with -t/--threads threads. Any simulated noise
+ * 	comes from a counter based generator seeded with -S/--seed (the seed is stored as
+ * 	NOISSEED in the primary header), so the output does not depend on the thread count.
+ *
  *
  *
  * \section notes Notes for the creator
@@ -105,16 +141,44 @@ class Application
 	 *
 	 * Garuntees the object index and number of object
 	 * initialisation */
-    Application() : mObjectIndex(-1), mNObjects(0) {};
+    Application() : mObjectIndex(-1), mNObjects(0), mSeed(0) {};
 
 
     int go(int argc, char *argv[]);
 
     private:
 
-    Lightcurve GenerateModel(const std::string &xmlfilename, const Lightcurve &SourceData);
-    Lightcurve GenerateModel(const std::string &xmlfilename);
+    /** Generate a model lightcurve
+     *
+     * ModelId selects the noise stream so each model gets independent
+     * but reproducible noise for a given seed */
+    Lightcurve GenerateModel(const std::string &xmlfilename, const Lightcurve &SourceData, const unsigned int ModelId=0);
+    Lightcurve GenerateModel(const std::string &xmlfilename, const unsigned int ModelId=0);
+
+    /** Generate a set of models on the data's time grid
+     *
+     * Files which only differ in planet radius share their geometry, which
+     * is computed once and evaluated for every radius. Model i gets the
+     * noise stream FirstModelId + i, the same as calling GenerateModel on
+     * each file in turn. */
+    std::vector<Lightcurve> GenerateModels(const std::vector<std::string> &xmlfilenames, const Lightcurve &SourceData,
+                                           const unsigned int FirstModelId);
     int ObjectIndex(const std::string &objName);
+
+    /** Noise stream of the subtraction model of the host at row 0
+     
+     Each host's subtraction model uses this plus its row, so hosts never
+     share noise frame by frame and the injected models, numbered from 1,
+     never reach these streams */
+    static const unsigned int SubModelStreams = 1u << 30;
+
+    /** Removes the host's transit and writes its synthetics
+     
+     The host is the object at mObjectIndex, its synthetics go to the
+     consecutive rows starting at FirstIndex and model i uses the noise
+     stream FirstModelId + i */
+    void InjectHost(const HostJob &Job, const int FirstIndex, const unsigned int FirstModelId,
+                    const double BatchMemory, const bool asWASP, ScratchArenas &Scratch);
 	std::valarray<double> getHDUData(const std::string &hduname);
     Lightcurve getObject();
 
@@ -137,6 +201,33 @@ class Application
 
     void CopyObject(const int LocationIndex);
 
+    /** Copies the selected object's catalogue row to nCopies consecutive rows
+     
+     Each column is written once for the whole range */
+    void CopyCatalogueRows(const int FirstIndex, const int nCopies);
+
+    /** Copies the selected object's image data to nCopies consecutive rows
+     
+     The source strip of each image is read once and the copies are written
+     with one fits_write_img call per image, or per block of rows if they do
+     not fit in MemoryLimit bytes.
+
+     \param IncludeFlux Also copy the flux, not needed if it is overwritten */
+    void CopyImageRows(const int FirstIndex, const int nCopies, const bool IncludeFlux, const double MemoryLimit);
+
+    /** Writes the flux of lcs to consecutive rows starting at FirstIndex
+     
+     One fits_write_img call per block of rows fitting in MemoryLimit bytes */
+    void WriteFluxRows(const std::vector<Lightcurve> &lcs, const int FirstIndex, const double MemoryLimit);
+
+    /** Updates the catalogue entries of a synthetic written to TargetIndex */
+    void UpdateCatalogue(const Lightcurve &lc, const int TargetIndex);
+
+    /** Updates the catalogue entries of synthetics written to consecutive rows
+     
+     The entries are staged by column and each column is written once */
+    void UpdateCatalogue(const std::vector<Lightcurve> &lcs, const int FirstIndex);
+
 
 	/** CCfits::FITS object auto_ptr for RAII */
 	std::auto_ptr<CCfits::FITS> mInfile;
@@ -149,6 +240,21 @@ class Application
 
 	/** Number of total objects in the data set */
     long mNObjects;
+
+    /** Rows of the source file's objects by identifier */
+    std::auto_ptr<ObjectIdIndex> mObjectIdIndex;
+
+    /** Destination of the synthetics in overlay mode, unset otherwise */
+    std::auto_ptr<OverlayWriter> mOverlay;
+
+    /** Journal of a file grown in place, unset otherwise */
+    std::auto_ptr<FileGrowth> mGrowth;
+
+    /** Seed for the model noise */
+    unsigned int mSeed;
+
+    /** Cache of generated models, models are always generated if not set */
+    std::auto_ptr<ModelCache> mCache;
 };
 
 
@@ -0,0 +1,37 @@
+#pragma once
+#ifndef CATALOGUEBUFFER_H
+
+#define CATALOGUEBUFFER_H
+
+#include <string>
+#include <vector>
+#include <CCfits/CCfits>
+#include "Lightcurve.h"
+
+/** Catalogue entries of consecutive synthetics, one vector per column
+ *
+ * Holds FLUX_MEAN, OBJ_ID, the FAKE_* parameters and SKIPDET, written
+ * with one call per column rather than one per cell. Any table with
+ * columns of these names can be written to.
+ */
+struct CatalogueBuffer
+{
+    std::vector<double> FluxMean, Radius, RStar, Period, Sep, Inclination, Epoch, Depth, Width;
+    std::vector<std::string> ObjID;
+    std::vector<unsigned int> Skipdet;
+
+    /** Adds the entries of lc
+     *
+     * skipdet is skiptfa for the original lightcurve so it is only
+     * ignored by tfa, and skipboth for a synthetic */
+    void Append(const Lightcurve &lc, unsigned int skipdet);
+
+    /** Writes the entries to the rows starting at FirstIndex (0-indexed) */
+    void Write(CCfits::ExtHDU &CatalogueHDU, int FirstIndex) const;
+
+    /** Number of rows held */
+    std::size_t size() const { return FluxMean.size(); }
+};
+
+
+#endif /* end of include guard: CATALOGUEBUFFER_H */
@@ -2,7 +2,26 @@
 
 #define COPYFILEEFFICIENTLY_H
 
+#include <string>
+#include <vector>
 
-void CopyFileEfficiently(const string &Filename, const int nExtra, const string &OutputFilename, const float fraction);
+namespace CCfits
+{
+    class ExtHDU;
+}
+
+/** Appends the catalogue columns the synthetics need (SKIPDET and FAKE_*) */
+void SyntheticColumns(std::vector<std::string> &names, std::vector<std::string> &formats, std::vector<std::string> &units);
+
+/** Copies Filename to OutputFilename with room for nExtra more objects
+ *
+ * nReserve further rows are left empty, flagged SKIPDET skipboth, so later
+ * runs with --append or --inplace fill them rather than growing the file.
+ * The catalogue then records the rows in use as ROWSUSED */
+void CopyFileEfficiently(const std::string &Filename, const int nExtra, const std::string &OutputFilename, const float fraction,
+                         const int nReserve = 0);
+
+/** Catalogue rows holding objects, ROWSUSED if the file has reserved rows */
+long UsedRows(CCfits::ExtHDU &catalogue);
 
 #endif /* end of include guard: COPYFILEEFFICIENTLY_H */
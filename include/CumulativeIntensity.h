@@ -0,0 +1,61 @@
+#pragma once
+#ifndef CUMULATIVEINTENSITY_H
+
+#define CUMULATIVEINTENSITY_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+/** Tabulated cumulative limb darkening integral
+ *
+ * Stores C(r) = \f$\int_0^r I(r') 2r' dr'\f$ on a regular grid in r
+ * between 0 and 1, so the integral between any two radii is two table
+ * lookups and a linear interpolation.
+ *
+ * Tables only depend on the limb darkening coefficients and grid step so
+ * they are built once and shared (read only) through CumulativeIntensity::Get.
+ */
+class CumulativeIntensity
+{
+    public:
+        /** Returns the shared table for this coefficient set and step
+         *
+         * Builds the table on first use. Safe to call from multiple threads */
+        static boost::shared_ptr<const CumulativeIntensity> Get(const std::vector<double> &coeffs, double dr);
+
+        /** Integral of I(r) * 2r between rlow and rhigh
+         *
+         * Equivalent to IntegratedI(dr, coeffs, rlow, rhigh) */
+        double Integral(double rlow, double rhigh) const
+        {
+            return Lookup(rhigh) - Lookup(rlow);
+        }
+
+    private:
+        CumulativeIntensity(const std::vector<double> &coeffs, double dr);
+
+        /** Interpolated value of C(r)
+         *
+         * The integrand is odd in r so C is even, and constant outside
+         * the stellar disc */
+        double Lookup(double r) const
+        {
+            r = r < 0. ? -r : r;
+            if (r >= 1.)
+                return mTable.back();
+
+            const double x = r * mInvStep;
+            const size_t j = static_cast<size_t>(x);
+            const double frac = x - j;
+            return mTable[j] + frac * (mTable[j+1] - mTable[j]);
+        }
+
+        /** Cumulative integral at r = j * step */
+        std::vector<double> mTable;
+
+        /** Reciprocal of the grid step */
+        double mInvStep;
+};
+
+
+#endif /* end of include guard: CUMULATIVEINTENSITY_H */
@@ -122,6 +122,33 @@ struct UsageError : public BaseException
     }
 };
 
+/** Exception for a model which cannot be interpolated */
+struct InterpolationError : public BaseException
+{
+    InterpolationError(const std::string &val) : BaseException(val)
+    {
+        type = "Interpolation error";
+    }
+};
+
+/** Exception for a failed low level file operation */
+struct FileCopyError : public BaseException
+{
+    FileCopyError(const std::string &val) : BaseException(val)
+    {
+        type = "File copy error";
+    }
+};
+
+/** Exception for an overlay file which does not match its source */
+struct OverlayError : public BaseException
+{
+    OverlayError(const std::string &val) : BaseException(val)
+    {
+        type = "Overlay error";
+    }
+};
+
 #endif /* end of include guard: EXCEPTIONS_H */
 
 
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef FILEGROWTH_H
+
+#define FILEGROWTH_H
+
+#include <string>
+#include <vector>
+#include <fitsio.h>
+#include <boost/noncopyable.hpp>
+
+/** Grows a data file in place to hold more objects
+ *
+ * Rows are added to the CATALOGUE table (along with the SKIPDET and FAKE_*
+ * columns if the file does not have them yet) and NAXIS2 of every image
+ * HDU is extended with cfitsio's resize functions, so the existing data is
+ * not copied to a new file.
+ *
+ * Before anything is changed the original sizes are written to a journal,
+ * <filename>.journal. The journal is removed by Commit once the new rows
+ * have been filled; if it is still there when the file is next grown the
+ * interrupted run is rolled back first.
+ *
+ * A copy made with --reserve has empty rows after the objects, counted by
+ * ROWSUSED in the CATALOGUE header, and these are filled first so nothing
+ * moves. cfitsio moves every following HDU when one grows past the padding
+ * at its end, rewriting most of the file, so Grow refuses any growth that
+ * would do that. Only the last HDU can grow without limit.
+ */
+class FileGrowth : boost::noncopyable
+{
+    public:
+        /** Constructor, rolls back an interrupted growth of filename */
+        explicit FileGrowth(const std::string &filename);
+
+        /** Adds room for nExtra objects, returns the number there were before
+         *
+         * Throws UsageError if the file would have to be rewritten */
+        long Grow(long nExtra);
+
+        /** Records the SKIPDET value of a row before it is changed */
+        void RecordSkipdet(long row, int value);
+
+        /** Marks the growth as complete by removing the journal */
+        void Commit();
+
+        /** Restores the sizes recorded in filename's journal, if any
+         *
+         * Returns true if there was something to roll back */
+        static bool Rollback(const std::string &filename);
+
+    private:
+        static std::string JournalName(const std::string &filename);
+
+        std::string mFilename;
+        bool mStarted;
+};
+
+
+#endif /* end of include guard: FILEGROWTH_H */
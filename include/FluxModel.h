@@ -0,0 +1,88 @@
+#pragma once
+#ifndef FLUXMODEL_H
+
+#define FLUXMODEL_H
+
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+class CumulativeIntensity;
+class FluxTable;
+
+/** Namespace for the flux engine selection
+
+ riemann is the original Riemann sum integration of the intensity
+ profile in steps of dr and is kept as the reference implementation.
+ It is evaluated with the vectorised IntegratedIKernel.
+
+ analytic evaluates the same intensity integral in closed form, so
+ no inner loop is required
+
+ cumulative looks the integral up in a CumulativeIntensity table built
+ once per set of coefficients
+
+ table interpolates the whole transit shape from a FluxTable, which is
+ persisted to disk between runs */
+namespace FluxEngine
+{
+    enum
+    {
+        riemann,
+        analytic,
+        cumulative,
+        table
+    };
+
+    /** Converts the xml engine name (case insensitive) into the enum value
+     *
+     * Throws an XMLException if the name is not known */
+    int FromString(const std::string &name);
+
+    /** Name of the engine for printing */
+    std::string ToString(int engine);
+}
+
+/** Normalised transit flux calculator
+ *
+ * Evaluates the Mandel & Agol small planet approximation with
+ * non-linear limb darkening for a projected separation z and
+ * radius ratio p. The limb darkening coefficients are fixed
+ * for the lifetime of the object.
+ */
+class FluxModel
+{
+    public:
+        /** Constructor
+         *
+         * \param coeffs Limb darkening coefficients c0-c4
+         * \param dr Integration step (riemann) or table step (cumulative)
+         * \param engine FluxEngine value
+         * \param tolerance Interpolation tolerance (table)
+         * \param directory Location of the table files (table) */
+        FluxModel(const std::vector<double> &coeffs, double dr, int engine,
+                  double tolerance=1E-5, const std::string &directory="");
+
+        /** Returns the normalised flux F(z, p) */
+        double Flux(double z, double p) const;
+
+        int engine() const { return mEngine; }
+
+    private:
+        /** Integral of I(r) * 2r between rlow and rhigh for the chosen engine */
+        double Integral(double rlow, double rhigh) const;
+
+        std::vector<double> mCoeffs;
+        double mOmega;
+        double mDR;
+        int mEngine;
+
+        /** Shared integral table, only set for the cumulative engine */
+        boost::shared_ptr<const CumulativeIntensity> mTable;
+
+        /** Shared transit shape, only set for the table engine */
+        boost::shared_ptr<const FluxTable> mFluxTable;
+};
+
+
+#endif /* end of include guard: FLUXMODEL_H */
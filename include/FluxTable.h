@@ -0,0 +1,97 @@
+#pragma once
+#ifndef FLUXTABLE_H
+
+#define FLUXTABLE_H
+
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+/** Precomputed transit shape F(z, p)
+ *
+ * For a fixed limb darkening law the normalised flux only depends on the
+ * projected separation z and the radius ratio p. This class tabulates the
+ * analytic flux for 0 < p <= FluxTable::MaxP and evaluates it by bilinear
+ * interpolation.
+ *
+ * F has kinks at the contact points z = 1 - p and z = 1 + p, so rather
+ * than gridding z directly the full transit (z <= 1 - p) and the ingress
+ * (1 - p < z <= 1 + p) are stored as separate grids in s = z / (1 - p)
+ * and s = (z - 1 + p) / 2p respectively. F is smooth inside each grid.
+ *
+ * The grids are refined until the interpolation error at the cell mid points
+ * is below the requested tolerance. Tables are expensive to build so they
+ * are written to disk and reused by later runs.
+ */
+class FluxTable
+{
+    public:
+        /** Largest radius ratio covered by the table */
+        static const double MaxP;
+
+        /** Returns the table for these coefficients and tolerance
+         *
+         * Looks in memory first, then for a table file in directory, and
+         * finally builds (and saves) a new table. */
+        static boost::shared_ptr<const FluxTable> Get(const std::vector<double> &coeffs, double tolerance,
+                                                      const std::string &directory);
+
+        /** Returns whether p is covered by the table */
+        static bool Contains(double p)
+        {
+            return (p > 0.) && (p <= MaxP);
+        }
+
+        /** Interpolated flux for z <= 1 + p and p inside the table */
+        double Flux(double z, double p) const
+        {
+            if (z <= 1. - p)
+            {
+                return Interpolate(mInner, z / (1. - p), p);
+            }
+
+            return Interpolate(mIngress, (z - 1. + p) / (2. * p), p);
+        }
+
+    private:
+        FluxTable(const std::vector<double> &coeffs, double tolerance);
+        FluxTable() {}
+
+        /** Bilinear interpolation in (s, p), 0 <= s <= 1 */
+        double Interpolate(const std::vector<double> &grid, double s, double p) const
+        {
+            const double x = s * (mNS - 1);
+            const double y = p * mInvPStep;
+            size_t i = static_cast<size_t>(x);
+            size_t j = static_cast<size_t>(y);
+            i = i < mNS - 1 ? i : mNS - 2;
+            j = j < mNP - 1 ? j : mNP - 2;
+            const double fx = x - i;
+            const double fy = y - j;
+
+            const double *row0 = &grid[j * mNS];
+            const double *row1 = row0 + mNS;
+            const double low = row0[i] + fx * (row0[i+1] - row0[i]);
+            const double high = row1[i] + fx * (row1[i+1] - row1[i]);
+            return low + fy * (high - low);
+        }
+
+        /** Fills both grids with ns x np nodes */
+        void Fill(const std::vector<double> &coeffs, size_t ns, size_t np);
+
+        /** Largest interpolation error found at the cell mid points
+         *
+         * Checks the mid points in s if alongS is true, otherwise in p */
+        double MaxError(const std::vector<double> &coeffs, bool alongS) const;
+
+        bool Load(const std::string &filename, const std::vector<double> &coeffs, double tolerance);
+        void Save(const std::string &filename, const std::vector<double> &coeffs, double tolerance) const;
+
+        /** Flux grids, p major */
+        std::vector<double> mInner, mIngress;
+        size_t mNS, mNP;
+        double mInvPStep;
+};
+
+
+#endif /* end of include guard: FLUXTABLE_H */
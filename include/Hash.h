@@ -0,0 +1,27 @@
+#pragma once
+#ifndef HASH_H
+
+#define HASH_H
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+/** Starting value for Fnv1a */
+const boost::uint64_t Fnv1aOffset = 14695981039346656037ULL;
+
+/** 64 bit FNV-1a hash of a block of memory
+ *
+ * Pass the previous result as hash to hash several blocks in turn */
+inline boost::uint64_t Fnv1a(const void *data, std::size_t nbytes, boost::uint64_t hash=Fnv1aOffset)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i=0; i<nbytes; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+#endif /* end of include guard: HASH_H */
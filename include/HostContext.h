@@ -0,0 +1,81 @@
+#pragma once
+#ifndef HOSTCONTEXT_H
+
+#define HOSTCONTEXT_H
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include "Lightcurve.h"
+#include "ModelSampler.h"
+
+/** A host lightcurve prepared for injecting many models
+ *
+ * Everything AddTransit works out from the data is computed once: the
+ * mean flux, the normalised flux, which points are valid and the time
+ * stamps in jd (converted from WASP seconds if needed). The host phase is
+ * cached for each period and epoch the current batch is folded on.
+ *
+ * Injecting a model gives the same result as AddTransit(host, model) with
+ * the host period and epoch set to the model's, as in Application::go.
+ */
+class HostContext : boost::noncopyable
+{
+    public:
+        /** Constructor
+         *
+         * \param host Host lightcurve, with any transit already removed */
+        explicit HostContext(const Lightcurve &host);
+
+        /** Inject a single model */
+        Lightcurve Inject(const Lightcurve &model);
+
+        /** Inject a batch of models, outputs[k] is the host with models[k] added
+         *
+         * The samples are processed in blocks, applying every model to a
+         * block before moving on, so the host arrays stay in cache. Any
+         * lightcurves already in outputs are reused, as are the samplers
+         * and the phases of the previous batch. With ScratchArenas
+         * installed and the same outputs passed every time, a batch no
+         * larger than the last one folded on the same ephemerides
+         * allocates nothing from the heap */
+        void Inject(const std::vector<Lightcurve> &models, std::vector<Lightcurve> &outputs);
+
+        /** Host phase folded on the given period (seconds) and epoch (days)
+         *
+         * The reference is valid until the next batch is injected */
+        const std::vector<double> &Phase(double period, double epoch);
+
+        /** Mean of the valid host flux */
+        double mean() const { return mMean; }
+
+    private:
+        /** Original host, copied for each output */
+        Lightcurve mHost;
+
+        /** Host time stamps in jd */
+        Lightcurve mTimeBase;
+
+        double mMean;
+
+        /** Host flux over its mean */
+        std::vector<double> mNormalised;
+
+        /** Runs of samples where both the time and flux are valid */
+        std::vector<IndexRange> mValidSpans;
+
+        typedef std::map<std::pair<double, double>, std::vector<double> > PhaseMap;
+
+        /** Drops the cached phases the models are not folded on */
+        void KeepPhases(const std::vector<Lightcurve> &models);
+
+        PhaseMap mPhases;
+
+        /** Samplers of the last batch, released once it is done */
+        boost::ptr_vector<ModelSampler> mSamplers;
+};
+
+
+#endif /* end of include guard: HOSTCONTEXT_H */
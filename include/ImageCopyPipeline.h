@@ -0,0 +1,90 @@
+#pragma once
+#ifndef IMAGECOPYPIPELINE_H
+
+#define IMAGECOPYPIPELINE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fitsio.h>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+/** Copies the values of image HDUs between two files with overlapping reads and writes
+ *
+ * A reader thread fills a ring of chunk buffers with fits_read_img while a
+ * writer thread empties them with fits_write_img. The reader moves on to
+ * the next image as soon as it has read the last chunk of one, so the
+ * images stream through without a pause between them. The values are
+ * converted to the same types as the original one chunk at a time copy.
+ *
+ * If cfitsio was not built reentrant the two files cannot be used from
+ * different threads and the chunks are read and written in turn.
+ */
+class ImageCopyPipeline : boost::noncopyable
+{
+    public:
+        /** Constructor
+         *
+         * \param infptr Input file
+         * \param outfptr Output file, every image must already exist
+         * \param MemoryLimit Bytes shared between the chunk buffers */
+        ImageCopyPipeline(fitsfile *infptr, fitsfile *outfptr, double MemoryLimit);
+
+        /** Adds an image to copy
+         *
+         * \param name Extension name, the same in both files
+         * \param bitpix Image type
+         * \param nElements Number of values copied from the start of the image */
+        void Add(const std::string &name, long bitpix, long nElements);
+
+        /** Copies every image, reporting the throughput of each */
+        void Run();
+
+    private:
+        struct Image
+        {
+            std::string name;
+            int datatype;
+            std::size_t elementSize;
+            long nElements;
+            double nBytes;
+
+            /*  writer side timing */
+            double start, end;
+        };
+
+        struct Chunk
+        {
+            std::vector<char> buffer;
+            std::size_t image;
+            long first, nElements;
+            bool last;
+        };
+
+        void ReadLoop();
+        void WriteLoop();
+        void RunInTurn();
+
+        /** Reads the next chunk, image and first are moved on past it */
+        int ReadChunk(std::size_t &image, long &first, Chunk &chunk);
+        int WriteChunk(Chunk &chunk);
+
+        void Fail(int status);
+        void Report() const;
+
+        fitsfile *mInfptr, *mOutfptr;
+        std::size_t mChunkBytes, mTotalChunks;
+        std::vector<Image> mImages;
+
+        /*  ring of chunk buffers, mFilled holds the slots waiting to be written */
+        std::vector<Chunk> mChunks;
+        std::deque<std::size_t> mFilled, mFree;
+        boost::mutex mMutex;
+        boost::condition_variable mFilledCondition, mFreeCondition;
+        int mStatus;
+};
+
+
+#endif /* end of include guard: IMAGECOPYPIPELINE_H */
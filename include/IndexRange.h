@@ -0,0 +1,13 @@
+#pragma once
+#ifndef INDEXRANGE_H
+
+#define INDEXRANGE_H
+
+#include <utility>
+#include <cstddef>
+
+/** Index range [first, second) of samples */
+typedef std::pair<std::size_t, std::size_t> IndexRange;
+
+
+#endif /* end of include guard: INDEXRANGE_H */
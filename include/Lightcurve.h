@@ -5,6 +5,9 @@
 
 #include <vector>
 #include <string>
+#include <boost/cstdint.hpp>
+#include "AlignedAllocator.h"
+#include "IndexRange.h"
 
 
 /** Lightcurve class which stores information about a single object
@@ -17,6 +20,17 @@ class Lightcurve
     size_t npts;
 
 public:
+    /** Column of values, 64 byte aligned */
+    typedef std::vector<double, AlignedAllocator<double, 64> > Column;
+
+    /** Columns which can be allocated */
+    enum
+    {
+        TimeColumn = 1,
+        FluxColumn = 2,
+        ErrorColumn = 4,
+        AllColumns = TimeColumn | FluxColumn | ErrorColumn
+    };
 
     /** Original wasp id */
     std::string obj_id;
@@ -45,13 +59,25 @@ public:
 	/**	Point of mid transit (days) */
     double epoch;
 
-	/** Time series for the time, flux and errors */
-    std::vector<double> jd, flux, fluxerr;
+	/** Time series for the time, flux and errors
+	 *
+	 * Columns which were not allocated are empty */
+    Column jd, flux, fluxerr;
 
 	/** Constructor
 	 *
-	 * Sets the size of the input vectors to be of size n*/
-    Lightcurve(size_t n);
+	 * Sets the size of the input vectors to be of size n. Models
+	 * only need the time and flux so can leave out the errors.
+	 *
+	 * \param n Number of data points
+	 * \param columns Columns to allocate, the rest are allocated by Allocate */
+    Lightcurve(size_t n, int columns=AllColumns);
+
+    /** Allocates any of the columns which are not already */
+    void Allocate(int columns);
+
+    /** True if all of the columns are allocated */
+    bool allocated(int columns) const;
 
 	/** Manually clears the timeseries vectors */
     void clear();
@@ -65,11 +91,77 @@ public:
 	 * the decimal part and creates the 0 point to be at the
 	 * point of mid transit.
 	 *
-	 * This phase information is not stored in the class itself. */
-    std::vector<double> phase();
+	 * The phase is cached and only recomputed when the period, epoch,
+	 * time base (asWASP) or number of points changes. The reference is
+	 * valid until the next call with different values. */
+    const std::vector<double> &phase() const;
+
+    /** Phase information folded on a different period (seconds) and epoch (days)
+     *
+     * Shares the cache with phase() */
+    const std::vector<double> &phase(double period, double epoch) const;
+
+    /** Drops the cached phase
+     *
+     * Only needed if the time stamps are changed in place after the
+     * phase has been computed */
+    void InvalidatePhase();
     
-    /** Assignment constructor */
+    /** Recomputes the validity mask
+     *
+     * Bit i of the mask is set if flux i is not null. flux is a public
+     * column so changing it does not touch the mask: anything that changes
+     * the flux of a lightcurve with a mask must call this again (or
+     * clear()) before the mask is used, as MeanFlux does. */
+    void UpdateValidity();
+
+    /** True if UpdateValidity has been called since construction or clear()
+     *
+     * Says nothing about changes to the flux made since */
+    bool hasValidity() const { return mHasValidity; }
+
+    /** True if flux i is not null */
+    bool valid(size_t i) const { return (mValid[i >> 6] >> (i & 63)) & 1; }
+
+    /** Number of non null flux values */
+    size_t nValid() const { return mNValid; }
+
+    /** Runs of consecutive non null flux values */
+    const std::vector<IndexRange> &ValidSpans() const { return mValidSpans; }
+
+    /** Copy constructor */
+    Lightcurve(const Lightcurve &obj);
+
+    /** Assignment constructor
+     *
+     * Reuses the existing column storage when it is large enough, so
+     * assigning into a lightcurve of the same size does not allocate */
     Lightcurve &operator=(const Lightcurve &obj);
+
+#if __cplusplus >= 201103L
+    /** Move constructor, takes the columns without copying */
+    Lightcurve(Lightcurve &&obj);
+
+    /** Move assignment, takes the columns without copying
+     *
+     * obj is left empty */
+    Lightcurve &operator=(Lightcurve &&obj);
+#endif
+
+    /** Exchanges the contents of two lightcurves without copying */
+    void swap(Lightcurve &obj);
+
+private:
+    /** Cached phase and what it was computed for */
+    mutable std::vector<double> mPhase;
+    mutable double mPhasePeriod, mPhaseEpoch;
+    mutable bool mPhaseWASP, mPhaseValid;
+
+    /** Packed validity bits, 64 points per word */
+    std::vector<boost::uint64_t> mValid;
+    std::vector<IndexRange> mValidSpans;
+    size_t mNValid;
+    bool mHasValidity;
 };
 
 
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef MANIFEST_H
+
+#define MANIFEST_H
+
+#include <string>
+#include <vector>
+
+/** One host object and the synthetics injected into it */
+struct HostJob
+{
+    /** Host object identifier */
+    std::string ObjectName;
+
+    /** Model subtracted from the host */
+    std::string SubModel;
+
+    /** Models added to the host, one synthetic each */
+    std::vector<std::string> AddModels;
+};
+
+/** Returns the object name from a model xml file */
+std::string ObjectFromXML(const std::string &xmlfilename);
+
+/** Reads a list of model files, one per line
+ *
+ * Relative paths are taken relative to the list's directory */
+std::vector<std::string> ReadModelList(const std::string &listfilename);
+
+/** Reads a manifest of hosts
+ *
+ * Each line holds the tab separated fields
+ *
+ *     [object id] submodel addmodels
+ *
+ * where addmodels is a list of model files as read by ReadModelList. If
+ * the object id is left out it is taken from the submodel. Blank lines
+ * and lines starting with # are skipped, relative paths are taken relative
+ * to the manifest's directory. */
+std::vector<HostJob> ReadManifest(const std::string &filename);
+
+
+#endif /* end of include guard: MANIFEST_H */
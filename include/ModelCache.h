@@ -0,0 +1,81 @@
+#pragma once
+#ifndef MODELCACHE_H
+
+#define MODELCACHE_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <deque>
+#include <boost/cstdint.hpp>
+
+/** Identifies a generated model
+ *
+ * params holds every value the model flux depends on (physical parameters,
+ * limb darkening, engine settings and noise stream) and grid is a
+ * fingerprint of the time samples. hash combines both and names the
+ * cache entry. */
+struct ModelKey
+{
+    std::vector<double> params;
+    boost::uint64_t grid;
+    boost::uint64_t hash;
+};
+
+/** Cache of generated model flux
+ *
+ * Models are kept in memory (up to a byte limit) and, if a directory is
+ * given, written to disk as model_<hash>.bin files. The on disk format is a
+ * small header followed by the raw flux array, 8 byte aligned, and is read
+ * back with mmap. Entries are checked against the full parameter list so
+ * a hash collision can never return the wrong model.
+ */
+class ModelCache
+{
+    public:
+        /** Constructor
+         *
+         * \param directory Location of the cache files, empty for memory only
+         * \param MemoryLimit Largest number of bytes of flux held in memory */
+        ModelCache(const std::string &directory, size_t MemoryLimit);
+
+        /** Builds the key for a set of parameters on a time grid */
+        static ModelKey MakeKey(const std::vector<double> &params, const std::vector<double> &Time);
+
+        /** Returns true and fills flux if the model has been cached */
+        bool Find(const ModelKey &key, std::vector<double> &flux);
+
+        /** Adds a model to the cache
+         *
+         * \param flux First of n flux values, taken as a pointer so any
+         * column type can be stored */
+        void Store(const ModelKey &key, const double *flux, size_t n);
+
+        long hits() const { return mHits; }
+        long misses() const { return mMisses; }
+
+    private:
+        struct Entry
+        {
+            ModelKey key;
+            std::vector<double> flux;
+        };
+
+        bool FindInMemory(const ModelKey &key, std::vector<double> &flux) const;
+        bool FindOnDisk(const ModelKey &key, std::vector<double> &flux) const;
+        void StoreInMemory(const ModelKey &key, const double *flux, size_t n);
+        void StoreOnDisk(const ModelKey &key, const double *flux, size_t n) const;
+        std::string Filename(const ModelKey &key) const;
+
+        std::string mDirectory;
+        size_t mMemoryLimit, mMemoryUsed;
+
+        /** In memory entries, oldest first in mOrder */
+        std::map<boost::uint64_t, Entry> mEntries;
+        std::deque<boost::uint64_t> mOrder;
+
+        long mHits, mMisses;
+};
+
+
+#endif /* end of include guard: MODELCACHE_H */
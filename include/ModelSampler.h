@@ -0,0 +1,96 @@
+#pragma once
+#ifndef MODELSAMPLER_H
+
+#define MODELSAMPLER_H
+
+#include <vector>
+#include <memory>
+#include <boost/noncopyable.hpp>
+#include "Lightcurve.h"
+#include "ScratchArena.h"
+
+class PhaseInterpolator;
+
+/** Model flux at each point of a data set
+ *
+ * If the model was made on the data's own time grid (same size, jd
+ * values within 1e-7 days, nulls in the same places and the same period
+ * and epoch as the data is folded on) the model flux is read directly.
+ * Otherwise the model is sorted by phase and linearly interpolated on to
+ * the data's phase with a PhaseInterpolator.
+ */
+class ModelSampler : boost::noncopyable
+{
+    public:
+        /** Constructor
+         *
+         * \param data Data set, only the time stamps are used
+         * \param model Model lightcurve, must outlive the sampler
+         * \param period Period (seconds) to fold the data on
+         * \param epoch Epoch (days) to fold the data on
+         * \param dataPhase Data phase on this period and epoch if already known,
+         * must outlive the sampler */
+        ModelSampler(const Lightcurve &data, const Lightcurve &model, double period, double epoch,
+                     const std::vector<double> *dataPhase=0);
+        ~ModelSampler();
+
+        /** Samples a different model, as if newly constructed
+         *
+         * The interpolator is reused so nothing is allocated outside the
+         * scratch arena */
+        void Reset(const Lightcurve &data, const Lightcurve &model, double period, double epoch,
+                   const std::vector<double> *dataPhase=0);
+
+        /** Gives back the scratch memory, Reset must be called before the
+         *  next Sample. A sampler kept across a ScratchArenas::Reset must
+         *  be released first */
+        void Release();
+
+        /** Model flux at data points [first, last) written to out, nan
+         * where the data phase is null */
+        void Sample(std::size_t first, std::size_t last, double *out) const;
+
+        /** True if the model is read directly */
+        bool direct() const { return mDirect; }
+
+    private:
+        const Lightcurve *mData;
+        const Lightcurve *mModel;
+        bool mDirect;
+
+        /*  interpolation only */
+        ScratchVector mOwnPhase;
+        const double *mDataPhase;
+        std::auto_ptr<PhaseInterpolator> mInterpolator;
+};
+
+/** Mean of the non null flux values
+ *
+ * Uses the validity mask if there is one, so it must match the flux */
+double MeanFlux(const Lightcurve &data);
+
+/** Removes (sign = -1) or adds (sign = 1) the model value at one data point
+ *
+ * The data is normalised by its mean, the model applied then the mean
+ * restored. Null data or model values give a null. */
+inline double ApplyModel(double dataFluxValue, double dataAv, double modelValue, double sign)
+{
+    if (modelValue != modelValue)
+    {
+        /*  phase is null */
+        return modelValue;
+    }
+
+    if (dataFluxValue != dataFluxValue)
+    {
+        /*  flux is null so put a null in the output array */
+        return dataFluxValue;
+    }
+
+    /*  both data and phase are well behaved */
+    const double NormalisedFluxValue = dataFluxValue / dataAv;
+    return ((NormalisedFluxValue + sign * modelValue) - sign) * dataAv;
+}
+
+
+#endif /* end of include guard: MODELSAMPLER_H */
@@ -0,0 +1,75 @@
+#pragma once
+#ifndef OBJECTIDINDEX_H
+
+#define OBJECTIDINDEX_H
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+namespace CCfits
+{
+    class ExtHDU;
+}
+
+/** Row index of every object in a file's catalogue, looked up by OBJ_ID
+ *
+ * The identifiers are sorted once and saved next to the fits file as
+ * <filename>.objidx, so later runs on the same file only load the sorted
+ * table instead of reading and converting the whole OBJ_ID column. The
+ * sidecar records the size and modification time (to the nanosecond) of
+ * the fits file and the DATASUM keyword of its catalogue, and is rebuilt
+ * if any of them do not match. Files without a DATASUM are checked on
+ * size and time alone. A checksum of the sidecar itself catches a
+ * damaged index.
+ *
+ * If an identifier appears more than once the first row is returned, the
+ * same as scanning the column from the start.
+ */
+class ObjectIdIndex
+{
+    public:
+        /** Loads the index of filename, building and saving it if needed */
+        explicit ObjectIdIndex(const std::string &filename);
+
+        /** Row of the object, -1 if it is not in the catalogue */
+        long Find(const std::string &objName) const;
+
+        /** Number of distinct identifiers */
+        std::size_t size() const { return mEntries.size(); }
+
+        /** OBJ_ID of a catalogue row (0-indexed), converted to a string as
+         *  the index does */
+        static std::string ObjectId(CCfits::ExtHDU &catalogue, long row);
+
+    private:
+        struct Entry
+        {
+            boost::uint64_t offset;
+            boost::uint32_t length;
+            boost::uint32_t row;
+        };
+
+        /** What the sidecar must match to be used */
+        struct SourceStamp
+        {
+            boost::uint64_t size;
+            boost::int64_t mtime;
+            boost::int64_t mtimeNsec;
+
+            /** Catalogue DATASUM, -1 if it has none */
+            boost::int64_t datasum;
+        };
+
+        bool Load(const std::string &sidecar, const SourceStamp &stamp);
+        void Build(const std::string &filename);
+        void Save(const std::string &sidecar, const SourceStamp &stamp) const;
+
+        /** Entries sorted by identifier, the identifiers are stored one
+         *  after another in mNames */
+        std::vector<Entry> mEntries;
+        std::vector<char> mNames;
+};
+
+
+#endif /* end of include guard: OBJECTIDINDEX_H */
@@ -0,0 +1,137 @@
+#pragma once
+#ifndef OVERLAY_H
+
+#define OVERLAY_H
+
+#include <string>
+#include <vector>
+#include <valarray>
+#include <memory>
+#include <CCfits/CCfits>
+#include <boost/noncopyable.hpp>
+#include "Lightcurve.h"
+#include "CatalogueBuffer.h"
+
+/** How a synthetic was made from its host, as stored in the overlay */
+struct OverlayRecipe
+{
+    /** Mean flux of the host, used to remove its transit */
+    double HostMean;
+
+    /** Mean flux with the transit removed, used to add the synthetic */
+    double RemovedMean;
+
+    /** Noise levels of the removed and injected models */
+    double SubNoise, AddNoise;
+
+    /** Noise streams of the removed and injected models */
+    unsigned int SubModelId, ModelId;
+};
+
+/** Replaces a host's flux with its synthetic's outside the transits
+ *
+ * Repeats the arithmetic of RemoveTransit followed by HostContext::Inject
+ * with both models at 1 plus their noise, so the frames outside the
+ * transits match a full injection exactly. The frames inside them are
+ * left for the stored differences.
+ *
+ * \param jd Host time stamps, only used to find the nulls
+ * \param flux Host flux on entry, synthetic flux on return
+ * \param seed Noise seed of the run */
+void RebuildSynthetic(const Lightcurve::Column &jd, Lightcurve::Column &flux, const OverlayRecipe &recipe,
+                      unsigned int seed);
+
+/** Writes synthetics as differences from their hosts
+ *
+ * Outside the removed and injected transits both models are 1 plus their
+ * noise, which is regenerated from the seed, so a synthetic follows from
+ * its host everywhere else. Instead of a full copy of the field the output
+ * holds one row per synthetic in the OVERLAY binary table:
+ *
+ *     HOSTROW          row of the host in the source file (0-indexed)
+ *     OBJ_ID           synthetic identifier
+ *     FLUX_MEAN        mean flux of the synthetic
+ *     FAKE_*           injected parameters, as in the catalogue
+ *     SKIPDET          detrending flags the synthetic would be given
+ *     HOSTMEAN         mean flux of the host
+ *     REMMEAN          mean flux of the host with its transit removed
+ *     SUBNOISE         noise level of the removed model
+ *     ADDNOISE         noise level of the injected model
+ *     SUBNOISEID       noise stream of the removed model
+ *     NOISEID          noise stream of the injected model
+ *     DELTAIDX         frames inside either transit
+ *     DELTAFLUX        flux of the synthetic at those frames
+ *
+ * The primary header holds the SOURCE filename, NFRAMES and NOISSEED.
+ * Every other image value is the host's, OverlayReader rebuilds the
+ * lightcurves.
+ */
+class OverlayWriter : boost::noncopyable
+{
+    public:
+        /** Constructor, creates (or overwrites) filename */
+        OverlayWriter(const std::string &filename, const std::string &SourceFilename, long nFrames, unsigned int seed);
+
+        /** Stages a synthetic of the host read from HostRow
+         *
+         * The models are the ones removed from and injected into the host,
+         * sampled on its time stamps. Their transits are found where they
+         * differ from 1 plus their noise. */
+        void Add(long HostRow, const Lightcurve &host, const OverlayRecipe &recipe, const Lightcurve &subModel,
+                 const Lightcurve &addModel, const Lightcurve &synthetic);
+
+        /** Writes the staged synthetics, each column in one call */
+        void Flush();
+
+        /** Number of synthetics written */
+        long rows() const { return mNRows; }
+
+    private:
+        std::auto_ptr<CCfits::FITS> mFile;
+        CCfits::ExtHDU *mTable;
+        long mNFrames, mNRows;
+        unsigned int mSeed;
+
+        std::vector<long> mHostRows;
+        std::vector<OverlayRecipe> mRecipes;
+        std::vector<std::valarray<int> > mDeltaIndex;
+        std::vector<std::valarray<double> > mDeltaFlux;
+        CatalogueBuffer mCatalogue;
+};
+
+/** Reads the synthetics of an overlay file
+ *
+ * Each lightcurve is materialised from its host's HJD, FLUX and FLUXERR
+ * in the source file, rebuilt outside the transits with RebuildSynthetic
+ * and with the stored flux inside them.
+ */
+class OverlayReader : boost::noncopyable
+{
+    public:
+        /** Constructor
+         *
+         * \param filename Overlay file
+         * \param SourceFilename Source file, the one recorded in the
+         * overlay if empty */
+        explicit OverlayReader(const std::string &filename, const std::string &SourceFilename="");
+
+        /** Number of synthetics */
+        long size() const { return mNRows; }
+
+        /** Row of synthetic i's host in the source file */
+        long HostRow(long i);
+
+        /** Lightcurve of synthetic i (0-indexed) with its injected parameters */
+        Lightcurve Read(long i);
+
+    private:
+        template <typename T>
+        T ReadCell(const std::string &column, long i);
+
+        std::auto_ptr<CCfits::FITS> mFile, mSource;
+        long mNFrames, mNRows;
+        unsigned int mSeed;
+};
+
+
+#endif /* end of include guard: OVERLAY_H */
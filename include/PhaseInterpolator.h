@@ -0,0 +1,103 @@
+#pragma once
+#ifndef PHASEINTERPOLATOR_H
+
+#define PHASEINTERPOLATOR_H
+
+#include <vector>
+#include <cstddef>
+#include "ScratchArena.h"
+
+/** Linear interpolation over a sorted table
+ *
+ * Gives exactly the same values as the Numerical Recipes Linear_interp:
+ * points outside the table are extrapolated from the first or last
+ * interval, and a zero width interval returns its left value. A nan
+ * input gives a nan.
+ *
+ * If the table is close to uniformly spaced the interval is found
+ * arithmetically and corrected by at most one step, otherwise it comes
+ * from a branch free binary search. The table is held as separate x and
+ * y arrays.
+ */
+class PhaseInterpolator
+{
+    public:
+        /** Constructor
+         *
+         * \param x Sorted table positions, at least two
+         * \param y Table values */
+        PhaseInterpolator(const std::vector<double> &x, const std::vector<double> &y);
+
+        /** Constructor taking the contents of x and y, which are left empty */
+        PhaseInterpolator(ScratchVector &x, ScratchVector &y);
+
+        /** Replaces the table with the contents of x and y, which are left empty */
+        void Assign(ScratchVector &x, ScratchVector &y);
+
+        /** Gives back the table's memory, Assign must be called before the
+         *  next use */
+        void clear();
+
+        /** Value at a single point */
+        double operator()(double x) const
+        {
+            return Evaluate(x, mUniform ? UniformIndex(x) : SearchIndex(x));
+        }
+
+        /** Values at n points, y[i] = (*this)(x[i]) */
+        void Interpolate(const double *x, double *y, std::size_t n) const;
+
+        /** True if the interval is found arithmetically */
+        bool uniform() const { return mUniform; }
+
+    private:
+        /** Checks the table and decides how intervals are found */
+        void Init();
+
+        /** Left end of the interval from the uniform spacing */
+        std::size_t UniformIndex(double x) const
+        {
+            /*  the estimate is at most one interval out, nans go to 0 */
+            double guess = (x - mX[0]) * mInvStep;
+            guess = guess >= 0 ? guess : 0;
+            guess = guess <= mLastIndex ? guess : mLastIndex;
+
+            std::size_t j = static_cast<std::size_t>(guess);
+            j += (j < mLastIndex) & (x >= mX[j + 1]);
+            j -= (j > 0) & (x < mX[j]);
+            return j;
+        }
+
+        /** Last table point at or below x, limited to [0, n-2] */
+        std::size_t SearchIndex(double x) const
+        {
+            const double *base = &mX[0];
+            std::size_t n = mLastIndex + 1;
+            while (n > 1)
+            {
+                const std::size_t half = n / 2;
+                base = (base[half] <= x) ? base + half : base;
+                n -= half;
+            }
+
+            return base - &mX[0];
+        }
+
+        /** Same arithmetic as Linear_interp::rawinterp */
+        double Evaluate(double x, std::size_t j) const
+        {
+            const double x0 = mX[j], x1 = mX[j + 1];
+            const double y0 = mY[j], y1 = mY[j + 1];
+            const double value = (x0 == x1) ? y0 : y0 + ((x - x0) / (x1 - x0)) * (y1 - y0);
+            return (x == x) ? value : x;
+        }
+
+        /** Table, held in the scratch arena while one exists */
+        ScratchVector mX, mY;
+        std::size_t mLastIndex;
+        double mInvStep;
+        bool mUniform;
+};
+
+
+#endif /* end of include guard: PHASEINTERPOLATOR_H */
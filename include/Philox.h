@@ -0,0 +1,86 @@
+#pragma once
+#ifndef PHILOX_H
+
+#define PHILOX_H
+
+#include <cmath>
+#include <boost/cstdint.hpp>
+
+/** Counter based random number generator (Philox4x32-10)
+ *
+ * Salmon et al. (2011), "Parallel random numbers: as easy as 1, 2, 3".
+ *
+ * Every random number is a pure function of the key and a counter so
+ * there is no generator state to share between threads. The noise for
+ * sample i of model m with seed s is always Philox(key = {s, m}, counter = i)
+ * no matter which thread (or how many threads) computes it.
+ */
+class Philox
+{
+    public:
+        typedef boost::uint32_t uint32;
+        typedef boost::uint64_t uint64;
+
+        /** Constructor
+         *
+         * \param seed User supplied seed
+         * \param stream Independent stream, e.g. the model number */
+        Philox(uint32 seed, uint32 stream)
+        {
+            mKey[0] = seed;
+            mKey[1] = stream;
+        }
+
+        /** Raw 128 bits of output for the given counter */
+        void Generate(uint64 counter, uint32 out[4]) const
+        {
+            uint32 ctr[4] = { static_cast<uint32>(counter), static_cast<uint32>(counter >> 32), 0, 0 };
+            uint32 key[2] = { mKey[0], mKey[1] };
+
+            for (int round=0; round<10; ++round)
+            {
+                if (round > 0)
+                {
+                    key[0] += 0x9E3779B9;
+                    key[1] += 0xBB67AE85;
+                }
+
+                const uint64 product0 = static_cast<uint64>(0xD2511F53) * ctr[0];
+                const uint64 product1 = static_cast<uint64>(0xCD9E8D57) * ctr[2];
+                const uint32 hi0 = static_cast<uint32>(product0 >> 32), lo0 = static_cast<uint32>(product0);
+                const uint32 hi1 = static_cast<uint32>(product1 >> 32), lo1 = static_cast<uint32>(product1);
+
+                ctr[0] = hi1 ^ ctr[1] ^ key[0];
+                ctr[1] = lo1;
+                ctr[2] = hi0 ^ ctr[3] ^ key[1];
+                ctr[3] = lo0;
+            }
+
+            for (int i=0; i<4; ++i)
+            {
+                out[i] = ctr[i];
+            }
+        }
+
+        /** Standard normal deviate for the given counter (Box-Muller) */
+        double Normal(uint64 counter) const
+        {
+            uint32 bits[4];
+            Generate(counter, bits);
+
+            /*  53 bit uniforms, u1 in (0, 1] so the log is finite */
+            const double scale = 1. / 9007199254740992.;
+            const uint64 word1 = (static_cast<uint64>(bits[1]) << 32) | bits[0];
+            const uint64 word2 = (static_cast<uint64>(bits[3]) << 32) | bits[2];
+            const double u1 = ((word1 >> 11) + 1) * scale;
+            const double u2 = (word2 >> 11) * scale;
+
+            return sqrt(-2. * log(u1)) * cos(2. * M_PI * u2);
+        }
+
+    private:
+        uint32 mKey[2];
+};
+
+
+#endif /* end of include guard: PHILOX_H */
@@ -0,0 +1,205 @@
+#pragma once
+#ifndef SCRATCHARENA_H
+
+#define SCRATCHARENA_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <new>
+#include <boost/noncopyable.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+/** Bump allocator for the temporary buffers used while processing a model
+ *
+ * Memory is handed out in 64 byte aligned pieces from one block and only
+ * given back all at once by Reset. If the block fills up further blocks
+ * are added; the next Reset replaces them with a single block as large as
+ * the peak usage, so after the first few models nothing is allocated.
+ */
+class ScratchArena : boost::noncopyable
+{
+    public:
+        /** Constructor
+         *
+         * \param capacity Initial block size in bytes */
+        explicit ScratchArena(std::size_t capacity);
+        ~ScratchArena();
+
+        /** Returns bytes of memory, valid until the next Reset */
+        void *Allocate(std::size_t bytes);
+
+        /** Makes all of the memory available again */
+        void Reset();
+
+        /** Bytes handed out since the last Reset */
+        std::size_t used() const { return mUsed; }
+
+        /** Largest number of bytes handed out between resets */
+        std::size_t peak() const { return mPeak; }
+
+        /** Bytes currently held */
+        std::size_t capacity() const;
+
+        /** Arena of the calling thread, 0 if no ScratchArenas exist
+         *
+         * A thread is given an arena of its own the first time it asks */
+        static ScratchArena *Current();
+
+    private:
+        struct Block
+        {
+            char *memory;
+            std::size_t size;
+        };
+
+        void AddBlock(std::size_t size);
+
+        std::vector<Block> mBlocks;
+        std::size_t mOffset, mUsed, mPeak;
+};
+
+/** One ScratchArena per thread for the lifetime of a run
+ *
+ * While an instance exists ScratchAllocator takes its memory from the
+ * calling thread's arena. The arena is found through thread local storage
+ * so OpenMP threads, nested regions and boost threads each get their own.
+ * A thread keeps its arena until the instance is destroyed. Only one
+ * instance may exist at a time, and no scratch buffer may outlive it or be
+ * kept across a Reset.
+ */
+class ScratchArenas : boost::noncopyable
+{
+    public:
+        /** Constructor
+         *
+         * \param capacity Initial size of each thread's arena in bytes */
+        explicit ScratchArenas(std::size_t capacity);
+        ~ScratchArenas();
+
+        /** Resets every thread's arena, call outside of parallel regions */
+        void Reset();
+
+        /** Sum of the bytes handed out by every arena since the last Reset */
+        std::size_t used() const;
+
+        /** Sum of the peak usage of every arena in bytes */
+        std::size_t peak() const;
+
+        /** Arena of the calling thread */
+        ScratchArena &Current();
+
+        /** The arenas of the run, 0 if none */
+        static ScratchArenas *Installed();
+
+        /** Arena i, in the order threads were given them */
+        ScratchArena &operator[](std::size_t i) { return mArenas[i]; }
+
+        std::size_t size() const { return mArenas.size(); }
+
+    private:
+        boost::ptr_vector<ScratchArena> mArenas;
+
+        /** Initial size of each arena in bytes */
+        std::size_t mCapacity;
+
+        /** Number of arenas given to threads so far */
+        std::size_t mNClaimed;
+        boost::mutex mMutex;
+
+        /** Declared after mArenas so it is cleared first */
+        boost::thread_specific_ptr<ScratchArena> mCurrent;
+};
+
+/** Scratch memory of at least bytes for the calling thread
+ *
+ * Comes from the thread's arena if ScratchArenas exist, otherwise from the
+ * heap. The owning arena is kept in a header just before the memory. */
+void *ScratchAllocate(std::size_t bytes);
+
+/** Gives back memory from ScratchAllocate, arena memory waits for a Reset */
+void ScratchFree(void *p);
+
+/** Allocator for std::vector taking memory from the thread's ScratchArena
+ *
+ * Falls back to the heap when no ScratchArenas exist. Freeing arena
+ * memory does nothing, it is reclaimed by ScratchArenas::Reset.
+ */
+template <typename T>
+class ScratchAllocator
+{
+    public:
+        typedef T value_type;
+        typedef T *pointer;
+        typedef const T *const_pointer;
+        typedef T &reference;
+        typedef const T &const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef ScratchAllocator<U> other;
+        };
+
+        ScratchAllocator() {}
+        ScratchAllocator(const ScratchAllocator &) {}
+        template <typename U>
+        ScratchAllocator(const ScratchAllocator<U> &) {}
+
+        pointer address(reference x) const { return &x; }
+        const_pointer address(const_reference x) const { return &x; }
+
+        pointer allocate(size_type n, const void * = 0)
+        {
+            if (n == 0)
+                return 0;
+
+            if (n > max_size())
+                throw std::bad_alloc();
+
+            return static_cast<pointer>(ScratchAllocate(n * sizeof(T)));
+        }
+
+        void deallocate(pointer p, size_type)
+        {
+            ScratchFree(p);
+        }
+
+        size_type max_size() const
+        {
+            /*  leaves room for the header */
+            return (static_cast<size_type>(-1) >> 1) / sizeof(T);
+        }
+
+        void construct(pointer p, const T &val)
+        {
+            new (static_cast<void*>(p)) T(val);
+        }
+
+        void destroy(pointer p)
+        {
+            p->~T();
+        }
+};
+
+template <typename T, typename U>
+inline bool operator==(const ScratchAllocator<T> &, const ScratchAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const ScratchAllocator<T> &, const ScratchAllocator<U> &)
+{
+    return false;
+}
+
+/** Temporary array of doubles */
+typedef std::vector<double, ScratchAllocator<double> > ScratchVector;
+
+
+#endif /* end of include guard: SCRATCHARENA_H */
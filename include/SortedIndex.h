@@ -8,8 +8,6 @@
 
 #define _USESTDVECTOR_
 #include <nr/nr3.h>
-#include <nr/interp_1d.h>
-#include <nr/interp_linear.h>
 
 
 
@@ -18,6 +16,22 @@ bool PairComparitor(const pair<double, int> &val1, const pair<double, int> &val2
     return (val1.first < val2.first);
 }
 
+/** Fills returned with (value, index) pairs of data sorted by value
+ *
+ * returned can be any vector of pairs, e.g. one using a ScratchAllocator */
+template <typename Data, typename Index>
+void SortedIndex(const Data &data, Index &returned)
+{
+    returned.resize(data.size());
+    for (size_t i=0; i<data.size(); ++i)
+    {
+        returned[i].first = data[i];
+        returned[i].second = i;
+    }
+
+    sort(returned.begin(), returned.end(), PairComparitor);
+}
+
 template <typename T>
 std::vector<std::pair<double, int> > SortedIndex(const std::vector<T> &data)
 {
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TRANSITWINDOW_H
+
+#define TRANSITWINDOW_H
+
+#include <vector>
+#include "IndexRange.h"
+
+/** Half the full transit duration, first to fourth contact
+ *
+ * Same geometry as the width stored in the catalogue,
+ * \f$\frac{P}{2\pi} \asin{\frac{\sqrt{(\frac{R_S + R_P}{a})^2 - \cos^2 i}}{\sin i}}\f$
+ * which is capped at a quarter of the period as no transit is modelled
+ * outside |phase| < 0.25.
+ *
+ * \param period Orbital period (seconds)
+ * \param normalisedDistance Separation in stellar radii, a / R_S
+ * \param p Radius ratio R_P / R_S
+ * \param inclination Inclination (radians)
+ *
+ * Returns 0 if the planet never crosses the stellar disc */
+double TransitHalfWidth(double period, double normalisedDistance, double p, double inclination);
+
+/** Locates the samples which fall inside a transit
+ *
+ * Time is in seconds from mid transit and must be sorted (no nans), in
+ * which case each window is found by binary search and the function
+ * returns true. Returns false if the time array is not sorted and
+ * the windows cannot be used.
+ *
+ * \param Time Time of each sample (seconds since mid transit)
+ * \param period Orbital period (seconds)
+ * \param halfWidth Half width of the transit window (seconds)
+ * \param windows Filled with the index range of each transit */
+bool FindTransitWindows(const std::vector<double> &Time, double period, double halfWidth,
+                        std::vector<IndexRange> &windows);
+
+
+#endif /* end of include guard: TRANSITWINDOW_H */
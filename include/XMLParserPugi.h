@@ -10,6 +10,19 @@
 
 using namespace std;
 
+/** Time sampling of a model generated without a data set */
+namespace PhaseGrid
+{
+	enum
+	{
+		/** Uniform steps of dt up to maxtime */
+		uniform,
+
+		/** Single period in phase, refined until linear interpolation is within the tolerance */
+		adaptive
+	};
+}
+
 
 /** Config namespace to keep the configuration parser seperate
  *
@@ -40,6 +53,10 @@ namespace Config
 		double dr;
 		double midpoint;
 		double noise;
+		int engine;
+		double tolerance;
+		int phasegrid;
+		double phaseTolerance;
 
 		/* xml specific variables */
 		/** Document node */
@@ -80,6 +97,8 @@ namespace Config
 		void m_getDR();
 		void m_getMidpoint();
 		void m_getNoise();
+		void m_getEngine();
+		void m_getPhaseGrid();
 
         /** Global data retrieval function */
         void m_getAll();
@@ -99,6 +118,10 @@ namespace Config
 		double getDR() { return this->dr; }
 		double getMidpoint() { return this->midpoint; }
 		double getNoise() { return this->noise; }
+		int getEngine() { return this->engine; }
+		double getTolerance() { return this->tolerance; }
+		int getPhaseGrid() { return this->phasegrid; }
+		double getPhaseTolerance() { return this->phaseTolerance; }
 	};
 
 }
@@ -1,189 +1,132 @@
 #include "AlterTransit.h"
-#include "SortedIndex.h"
+#include "ModelSampler.h"
 #include "CopyParameters.h"
 #include <vector>
+#include <cmath>
+#include <algorithm>
 
 
 using namespace std;
 
-
-
-Lightcurve RemoveTransit(Lightcurve &data, Lightcurve &model)
+namespace
 {
-    /*  get the phase values */
-    /*  the model SHOULD NOT contain nans */
-    vector<double> modelPhase = model.phase();
-
-    /*  must sort the input to the interpolator */
-    vector<pair<double, int> > SortedModelPhase = SortedIndex(modelPhase);
-    vector<double> SortedPhaseOnly(modelPhase.size()), SortedModelOnly(modelPhase.size());
-    for (size_t i=0; i<modelPhase.size(); ++i)
-    {
-        SortedPhaseOnly[i] = SortedModelPhase[i].first;
-        SortedModelOnly[i] = model.flux[SortedModelPhase[i].second];
-    }
-
-
-    
-    /*  set up the output values initially as a copy of the input data */
-    Lightcurve output = data;
-
-    /* Update the physical parameters */
-    CopyParameters(model, output);
+    /** Number of model samples held at a time, on the stack */
+    const size_t BlockSize = 2048;
 
-    
-    Linear_interp interpolator(SortedPhaseOnly, SortedModelOnly);
-
-    
-    /*  calculate the average of the data */
-    double dataAv = 0;
-    int dataCounter = 0;
-    for (vector<double>::const_iterator i=data.flux.begin();
-         i!=data.flux.end();
-         ++i)
+    /** Common part of RemoveTransit and AddTransit */
+    void ApplyTransit(const Lightcurve &data, const Lightcurve &model, double sign, Lightcurve &output)
     {
-        if (!isnan(*i))
-        {
-            /*  not nan */
-            dataAv += *i;
-            ++dataCounter;
-        }
-    }
-
-    dataAv /= (double)dataCounter;
+        ModelSampler sampler(data, model, data.period, data.epoch);
 
+        /*  calculate the average of the data */
+        const double dataAv = MeanFlux(data);
 
+        /*  set up the output values initially as a copy of the input data */
+        if (&output != &data)
+            output = data;
 
-    /*  now interpolate onto the data's phase grid */
-    vector<double> dataPhase = data.phase();
-    /*  create the output array */
-    for (size_t i=0; i<dataPhase.size(); ++i)
-    {
-        double InterpolatedModelValue = interpolator.interp(dataPhase[i]);
+        /* Update the physical parameters */
+        CopyParameters(model, output);
 
-        /*  get the data phase value */
-        double dataPhaseValue = dataPhase[i];
-        if (isnan(dataPhaseValue))
-        {
-            /*  phase is null so ignore for now */
-            output.flux[i] = dataPhaseValue;
-        }
-        else
+        double modelFlux[BlockSize];
+        for (size_t first=0; first<data.flux.size(); first+=BlockSize)
         {
-            /*  get the data flux value */
-            double dataFluxValue = data.flux[i];
-            if (isnan(dataFluxValue))
-            {
-                /*  flux is null so put a null in the output array */
-                output.flux[i] = dataFluxValue;
-            }
-            else
+            const size_t last = min(first + BlockSize, data.flux.size());
+            sampler.Sample(first, last, modelFlux);
+
+            for (size_t i=first; i<last; ++i)
             {
-                /*  both data and phase are well behaved */
-                double NormalisedFluxValue = dataFluxValue / dataAv;
-                output.flux[i] = ((NormalisedFluxValue - InterpolatedModelValue) + 1.0) * dataAv;
+                output.flux[i] = ApplyModel(data.flux[i], dataAv, modelFlux[i - first], sign);
             }
         }
 
-
+        output.UpdateValidity();
     }
-    
+}
 
-    
-        
-    
+
+Lightcurve RemoveTransit(Lightcurve &data, Lightcurve &model)
+{
+    Lightcurve output(0);
+    ApplyTransit(data, model, -1., output);
     return output;
-        
+}
+
+void RemoveTransit(const Lightcurve &data, const Lightcurve &model, Lightcurve &output)
+{
+    ApplyTransit(data, model, -1., output);
 }
 
 
 
 Lightcurve AddTransit(Lightcurve &data, Lightcurve &model)
 {
-    /*  get the phase values */
-    /*  the model SHOULD NOT contain nans */
-    vector<double> modelPhase = model.phase();
-
-    /*  must sort the input to the interpolator */
-    vector<pair<double, int> > SortedModelPhase = SortedIndex(modelPhase);
-    vector<double> SortedPhaseOnly(modelPhase.size()), SortedModelOnly(modelPhase.size());
-    for (size_t i=0; i<modelPhase.size(); ++i)
-    {
-        SortedPhaseOnly[i] = SortedModelPhase[i].first;
-        SortedModelOnly[i] = model.flux[SortedModelPhase[i].second];
-    }
-
+    Lightcurve output(0);
+    ApplyTransit(data, model, 1., output);
+    return output;
+}
 
-    
-    /*  set up the output values initially as a copy of the input data */
-    Lightcurve output = data;
+void AddTransit(const Lightcurve &data, const Lightcurve &model, Lightcurve &output)
+{
+    ApplyTransit(data, model, 1., output);
+}
 
-    /* Update the physical parameters */
-    CopyParameters(model, output);
-    
-    Linear_interp interpolator(SortedPhaseOnly, SortedModelOnly);
+Lightcurve ReplaceTransit(Lightcurve &data, Lightcurve &subModel, Lightcurve &addModel)
+{
+    Lightcurve output(0);
+    ReplaceTransit(data, subModel, addModel, output);
+    return output;
+}
 
-    
-    /*  calculate the average of the data */
-    double dataAv = 0;
-    int dataCounter = 0;
-    for (vector<double>::const_iterator i=data.flux.begin();
-         i!=data.flux.end();
-         ++i)
-    {
-        if (!isnan(*i))
-        {
-            /*  not nan */
-            dataAv += *i;
-            ++dataCounter;
-        }
-    }
+void ReplaceTransit(const Lightcurve &data, const Lightcurve &subModel, const Lightcurve &addModel, Lightcurve &output)
+{
+    /*  the addition is folded on the added model's ephemeris, as AlterTransit does */
+    ModelSampler subSampler(data, subModel, data.period, data.epoch);
+    ModelSampler addSampler(data, addModel, addModel.period, addModel.epoch);
 
-    dataAv /= (double)dataCounter;
+    const double dataAv = MeanFlux(data);
 
+    if (&output != &data)
+        output = data;
 
+    CopyParameters(addModel, output);
 
-    /*  now interpolate onto the data's phase grid */
-    vector<double> dataPhase = data.phase();
-    
-    /*  create the output array */
-    for (size_t i=0; i<dataPhase.size(); ++i)
+    /*  the subtracted flux is held in the output until its mean is known */
+    double modelFlux[BlockSize];
+    double removedAv = 0;
+    int removedCounter = 0;
+    for (size_t first=0; first<data.flux.size(); first+=BlockSize)
     {
-        double InterpolatedModelValue = interpolator.interp(dataPhase[i]);
+        const size_t last = min(first + BlockSize, data.flux.size());
+        subSampler.Sample(first, last, modelFlux);
 
-        /*  get the data phase value */
-        double dataPhaseValue = dataPhase[i];
-        if (isnan(dataPhaseValue))
-        {
-            /*  phase is null so ignore for now */
-            output.flux[i] = dataPhaseValue;
-        }
-        else
+        for (size_t i=first; i<last; ++i)
         {
-            /*  get the data flux value */
-            double dataFluxValue = data.flux[i];
-            if (isnan(dataFluxValue))
-            {
-                /*  flux is null so put a null in the output array */
-                output.flux[i] = dataFluxValue;
-            }
-            else
+            const double removed = ApplyModel(data.flux[i], dataAv, modelFlux[i - first], -1.);
+            output.flux[i] = removed;
+
+            if (!isnan(removed))
             {
-                /*  both data and phase are well behaved */
-                double NormalisedFluxValue = dataFluxValue / dataAv;
-                output.flux[i] = ((NormalisedFluxValue + InterpolatedModelValue) - 1.0) * dataAv;
+                removedAv += removed;
+                ++removedCounter;
             }
         }
+    }
 
+    removedAv /= (double)removedCounter;
 
+    for (size_t first=0; first<output.flux.size(); first+=BlockSize)
+    {
+        const size_t last = min(first + BlockSize, output.flux.size());
+        addSampler.Sample(first, last, modelFlux);
+
+        for (size_t i=first; i<last; ++i)
+        {
+            output.flux[i] = ApplyModel(output.flux[i], removedAv, modelFlux[i - first], 1.);
+        }
     }
-    
 
-    
-        
-    
-    return output;
-        
+    output.UpdateValidity();
 }
 
 Lightcurve AlterTransit(Lightcurve &data, Lightcurve &subModel, Lightcurve &addModel, bool WASP, bool addModelFlag)
@@ -204,26 +147,15 @@ Lightcurve AlterTransit(Lightcurve &data, Lightcurve &subModel, Lightcurve &addM
     addModel.asWASP = false;
 
     
-    Lightcurve LCRemoved = RemoveTransit(data, subModel);
-
     if (addModelFlag)
     {
-
-
-        /*  then add */
-        LCRemoved.period = addModel.period;
-        LCRemoved.epoch = addModel.epoch;
-        Lightcurve LCAdded = AddTransit(LCRemoved, addModel);
-
-
-
-        //debugfile.close();
-        return LCAdded;
+        /*  then add, in the same pass */
+        return ReplaceTransit(data, subModel, addModel);
     }
     else
     {
-        /*  do not add the model, just return the LCRemoved object */
-        return LCRemoved;
+        /*  do not add the model, just return the subtracted lightcurve */
+        return RemoveTransit(data, subModel);
     }
 
 }
@@ -2,6 +2,7 @@
 #include "Exceptions.h"
 
 #include <CCfits/CCfits>
+#include <algorithm>
 
 using namespace std;
 using namespace CCfits;
@@ -10,20 +11,42 @@ typedef map<string, Column*> ColumnList;
 typedef list<string> StringList;
 
 template <class T>
-void CopyData(ExtHDU &CurrentHDU, int SourceIndex, int DestIndex, fitsfile *fptr)
+void CopyData(ExtHDU &CurrentHDU, int SourceIndex, int FirstIndex, int nCopies, double MemoryLimit, fitsfile *fptr)
 {
     valarray<T> data;
-    const int nFrames = CurrentHDU.axis(0);
+    const long nFrames = CurrentHDU.axis(0);
     CurrentHDU.read(data, (SourceIndex*nFrames) + 1, nFrames);
 
     /*  need to get the data type */
     FITSUtil::MatchType<T> type;
 
+    /*  the copies are contiguous so go out in as few writes as memory allows */
+    const long nRows = max(1L, min(long(nCopies), long(MemoryLimit / (nFrames * sizeof(T)))));
+    vector<T> buffer(nRows * nFrames);
+    for (long row=0; row<nRows; ++row)
+    {
+        copy(&data[0], &data[0] + nFrames, buffer.begin() + row * nFrames);
+    }
+
     int status = 0;
-    /*  must write efficiently now */
-    fits_write_img(fptr, type(), (DestIndex*nFrames) + 1, nFrames, &data[0], &status);
+    for (long first=0; first<nCopies; first+=nRows)
+    {
+        const long nWrite = min(nRows, nCopies - first);
+        fits_write_img(fptr, type(), ((FirstIndex + first)*nFrames) + 1, nWrite * nFrames, &buffer[0], &status);
+
+        if (status) throw FitsioException(status);
+    }
+}
 
-    if (status) throw FitsioException(status);
+/** Copies one catalogue cell to nCopies consecutive rows with a single write */
+template <class T>
+void CopyCell(Column &column, int SourceIndex, int FirstIndex, int nCopies)
+{
+    vector<T> data;
+    column.read(data, SourceIndex + 1, SourceIndex + 1);
+    const T value = data[0];
+    data.assign(nCopies, value);
+    column.write(data, FirstIndex + 1);
 }
 
 /** Copies an object at given index to another location in the file
@@ -35,6 +58,12 @@ void Application::CopyObject(const int LocationIndex)
      *      - Catalogue entries
      *      - Image data in a strip
      */
+    CopyCatalogueRows(LocationIndex, 1);
+    CopyImageRows(LocationIndex, 1, true, 0);
+}
+
+void Application::CopyCatalogueRows(const int FirstIndex, const int nCopies)
+{
     ExtHDU &CatalogueHDU = mInfile->extension("CATALOGUE");
     ColumnList Columns = CatalogueHDU.column();
 
@@ -49,59 +78,46 @@ void Application::CopyObject(const int LocationIndex)
         if (Format == "1J")
         {
             /*  data type is long */
-            vector<long> data;
-            i->second->read(data, mObjectIndex + 1, mObjectIndex + 1);
-            i->second->write(data, LocationIndex + 1);
-
+            CopyCell<long>(*i->second, mObjectIndex, FirstIndex, nCopies);
         }
         else if (Format == "1I")
         {
             /*  data type is int */
-            vector<int> data;
-            i->second->read(data, mObjectIndex + 1, mObjectIndex + 1);
-            i->second->write(data, LocationIndex + 1);
-
+            CopyCell<int>(*i->second, mObjectIndex, FirstIndex, nCopies);
         }
         else if (Format == "1E")
         {
             /*  data type is float */
-            vector<float> data;
-            i->second->read(data, mObjectIndex + 1, mObjectIndex + 1);
-            i->second->write(data, LocationIndex + 1);
-
+            CopyCell<float>(*i->second, mObjectIndex, FirstIndex, nCopies);
         }
         else if (Format == "26A")
         {
             /*  data type is string */
-            vector<string> data;
-            i->second->read(data, mObjectIndex + 1, mObjectIndex + 1);
-            i->second->write(data, LocationIndex + 1);
-
+            CopyCell<string>(*i->second, mObjectIndex, FirstIndex, nCopies);
         }
         else if (Format == "1D")
         {
             /*  data type is double */
-            vector<double> data;
-            i->second->read(data, mObjectIndex + 1, mObjectIndex + 1);
-            i->second->write(data, LocationIndex + 1);
-
+            CopyCell<double>(*i->second, mObjectIndex, FirstIndex, nCopies);
         }
         else if (Format == "B")
         {
             /* data type is byte */
-            vector<double> data;
-            i->second->read(data, mObjectIndex+1, mObjectIndex+1);
-            i->second->write(data, LocationIndex+1);
+            CopyCell<double>(*i->second, mObjectIndex, FirstIndex, nCopies);
         }
         else
         {
             cerr << "Unknown data type: " << Format << endl;
         }
     }
+}
 
+void Application::CopyImageRows(const int FirstIndex, const int nCopies, const bool IncludeFlux, const double MemoryLimit)
+{
     StringList HDUList;
     HDUList.push_back("HJD");
-    HDUList.push_back("FLUX");
+    if (IncludeFlux)
+        HDUList.push_back("FLUX");
     HDUList.push_back("FLUXERR");
     HDUList.push_back("CCDX");
     HDUList.push_back("CCDY");
@@ -124,22 +140,22 @@ void Application::CopyObject(const int LocationIndex)
         switch (bitpix)
         {
             case BYTE_IMG:
-                CopyData<unsigned int>(CurrentHDU, mObjectIndex, LocationIndex, this->fptr);
+                CopyData<unsigned int>(CurrentHDU, mObjectIndex, FirstIndex, nCopies, MemoryLimit, this->fptr);
                 break;
             case SHORT_IMG:
-                CopyData<int>(CurrentHDU, mObjectIndex, LocationIndex, this->fptr);
+                CopyData<int>(CurrentHDU, mObjectIndex, FirstIndex, nCopies, MemoryLimit, this->fptr);
                 break;
             case LONG_IMG:
-                CopyData<long>(CurrentHDU, mObjectIndex, LocationIndex, this->fptr);
+                CopyData<long>(CurrentHDU, mObjectIndex, FirstIndex, nCopies, MemoryLimit, this->fptr);
                 break;
             case LONGLONG_IMG:
-                CopyData<long long>(CurrentHDU, mObjectIndex, LocationIndex, this->fptr);
+                CopyData<long long>(CurrentHDU, mObjectIndex, FirstIndex, nCopies, MemoryLimit, this->fptr);
                 break;
             case FLOAT_IMG:
-                CopyData<float>(CurrentHDU, mObjectIndex, LocationIndex, this->fptr);
+                CopyData<float>(CurrentHDU, mObjectIndex, FirstIndex, nCopies, MemoryLimit, this->fptr);
                 break;
             case DOUBLE_IMG:
-                CopyData<double>(CurrentHDU, mObjectIndex, LocationIndex, this->fptr);
+                CopyData<double>(CurrentHDU, mObjectIndex, FirstIndex, nCopies, MemoryLimit, this->fptr);
                 break;
             default:
                 cerr << "Unknown HDU type encountered: " << bitpix << endl;
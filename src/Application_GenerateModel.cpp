@@ -5,27 +5,244 @@
 #include "FuncSquare.h"
 #include "FuncIntensity.h"
 #include "FuncOmega.h"
+#include "FluxModel.h"
+#include "TransitWindow.h"
+#include "Philox.h"
+#include "ModelCache.h"
 #include "WaspDateConverter.h"
 #include "CopyParameters.h"
+#include "ScratchArena.h"
+#include <map>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
 
 #define _USESTDVECTOR_
 #include <nr/nr3.h>
-#include <nr/ran.h>
-#include <nr/gamma.h>
-#include <nr/deviates.h>
 
 namespace
 {
+    /** Projected separation z of a single sample at time t (seconds since mid transit)
+     
+     Returns a negative value outside the primary transit phase. Only depends on the
+     geometry so can be shared between planets of different sizes */
+    double SampleSeparation(double t, double angFreq, double cosi, double normalisedDistance, double period)
+    {
+        /* get the normalised device coordinates */
+        double firstTerm = square(sin(angFreq * t));
+        double secondTerm = square(cosi * cos(angFreq * t));
+        
+        double z = normalisedDistance * sqrt(firstTerm + secondTerm);
+        
+        double intpart;
+        double phase = fabs(modf(t  / period , &intpart));
+        phase = phase > 0.5 ? phase - 1.0 : phase;
+        
+        /* Hack to make sure the secondary eclipse is not created */
+        if ((phase > -0.25) && (phase < 0.25))
+        {
+            return z;
+        }
+        
+        return -1.;
+    }
+
+    /** Flux of a single sample at time t (seconds since mid transit) */
+    double SampleFlux(double t, double angFreq, double cosi, double normalisedDistance, double period,
+                      double p, const FluxModel &model)
+    {
+        const double z = SampleSeparation(t, angFreq, cosi, normalisedDistance, period);
+        return z < 0 ? 1. : model.Flux(z, p);
+    }
+
+    /** Phase of the contact points at which the planet's limb meets the stellar limb
+     
+     Returns -1 if the separation z is never reached */
+    double ContactPhase(double z, double normalisedDistance, double inclination)
+    {
+        const double sini = sin(inclination);
+        const double cosi = cos(inclination);
+        const double sinSquared = (square(z / normalisedDistance) - square(cosi)) / square(sini);
+
+        if ((sinSquared < 0) || (sinSquared > 1))
+            return -1.;
+
+        return asin(sqrt(sinSquared)) / (2. * M_PI);
+    }
+
+    /** Recursively splits [a, b] until linear interpolation is within tolerance
+     
+     Appends every node after a (up to and including b) */
+    void RefinePhase(double a, double fa, double b, double fb, double period, double angFreq, double cosi,
+                     double normalisedDistance, double p, const FluxModel &model, double tolerance,
+                     vector<double> &Phase, vector<double> &Flux)
+    {
+        /* Smallest interval, well above the jd precision */
+        const double MinWidth = 1E-7;
+
+        const double mid = 0.5 * (a + b);
+        const double fmid = SampleFlux(mid * period, angFreq, cosi, normalisedDistance, period, p, model);
+
+        /* the centre underestimates the largest error near grazing contacts, hence the factor of two */
+        if ((b - a > 2. * MinWidth) && (fabs(fmid - 0.5 * (fa + fb)) > 0.5 * tolerance))
+        {
+            RefinePhase(a, fa, mid, fmid, period, angFreq, cosi, normalisedDistance, p, model, tolerance, Phase, Flux);
+            RefinePhase(mid, fmid, b, fb, period, angFreq, cosi, normalisedDistance, p, model, tolerance, Phase, Flux);
+        }
+        else
+        {
+            Phase.push_back(b);
+            Flux.push_back(fb);
+        }
+    }
+
+    /** Model over a single period sampled on an adaptive phase grid
+     
+     The contact points are always grid nodes so the flux is smooth between
+     neighbouring nodes, and each interval is halved until the flux at its
+     centre is within tolerance of the linear interpolation. Phase runs over
+     (-0.5, 0.5] in increasing order, the same convention as Lightcurve::phase */
+    void AdaptivePhaseGrid(double period, double normalisedDistance, double p, double inclination,
+                           const FluxModel &model, double tolerance, vector<double> &Phase, vector<double> &Flux)
+    {
+        const double angFreq = 2. * M_PI / period;
+        const double cosi = cos(inclination);
+
+        /* coarse grid plus the contact points */
+        const int nCoarse = 64;
+        vector<double> nodes;
+        for (int i=0; i<=nCoarse; ++i)
+        {
+            nodes.push_back(-0.5 + double(i) / nCoarse);
+        }
+
+        const double contacts[2] = { 1. + p, 1. - p };
+        for (int i=0; i<2; ++i)
+        {
+            const double phase = ContactPhase(contacts[i], normalisedDistance, inclination);
+            if ((phase > 0) && (phase < 0.25))
+            {
+                nodes.push_back(phase);
+                nodes.push_back(-phase);
+            }
+        }
+
+        sort(nodes.begin(), nodes.end());
+        nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+
+        Phase.clear();
+        Flux.clear();
+
+        double fa = SampleFlux(nodes[0] * period, angFreq, cosi, normalisedDistance, period, p, model);
+        for (size_t i=1; i<nodes.size(); ++i)
+        {
+            const double fb = SampleFlux(nodes[i] * period, angFreq, cosi, normalisedDistance, period, p, model);
+            RefinePhase(nodes[i-1], fa, nodes[i], fb, period, angFreq, cosi, normalisedDistance, p, model, tolerance,
+                        Phase, Flux);
+            fa = fb;
+        }
+    }
+
+    /** Everything the model flux depends on, used for the model cache key */
+    vector<double> CacheParameters(Config::Config &config, const unsigned int seed, const unsigned int ModelId)
+    {
+        vector<double> params;
+        params.push_back(config.getPlanetRadius());
+        params.push_back(config.getStarRadius());
+        params.push_back(config.getPeriod());
+        params.push_back(config.getSemi());
+        params.push_back(config.getInclination());
+        params.push_back(config.getMidpoint());
+        params.insert(params.end(), config.getCoeffs().begin(), config.getCoeffs().end());
+        params.push_back(config.getDR());
+        params.push_back(config.getEngine());
+        params.push_back(config.getTolerance());
+        params.push_back(config.getNoise());
+
+        /* the noise stream only matters if there is noise */
+        if (config.getNoise() != 0)
+        {
+            params.push_back(seed);
+            params.push_back(ModelId);
+        }
+
+        return params;
+    }
+
+    /** Time of each data point in seconds since the transit mid point */
+    vector<double> DataTime(const Lightcurve &SourceData, double midpoint)
+    {
+        vector<double> TimeData(SourceData.jd.begin(), SourceData.jd.end());
+        
+        /* Need to convert this to time since epoch */
+        const double DataEpoch = midpoint;
+        if (SourceData.asWASP)
+        {
+            /* Data already in seconds so ignore */
+            for (vector<double>::iterator i=TimeData.begin();
+                 i!=TimeData.end();
+                 ++i)
+            {
+                *i = *i - jd2wd(DataEpoch);
+                
+            }
+        
+        }
+        else
+        {
+            for (vector<double>::iterator i=TimeData.begin();
+                 i!=TimeData.end();
+                 ++i)
+            {
+                *i = (*i - DataEpoch) * secondsInDay;
+                
+            }
+        }
+
+        return TimeData;
+    }
+
+    /** Everything except the planet radius, models with equal values share their geometry */
+    vector<double> GeometryParameters(Config::Config &config)
+    {
+        vector<double> params = CacheParameters(config, 0, 0);
+        params.erase(params.begin());
+        return params;
+    }
+
+    /** Builds a model lightcurve from previously computed flux values
+     
+     flux points to one value per time sample, so rows of a batch can be
+     used without copying them out first */
+    Lightcurve ModelLightcurve(const vector<double> &Time, const double *flux, double period, double midpoint, double rPlan)
+    {
+        Lightcurve lc(Time.size(), Lightcurve::TimeColumn | Lightcurve::FluxColumn);
+        lc.period = period;
+        lc.epoch = midpoint;
+        lc.flux.assign(flux, flux + Time.size());
+
+        for (size_t i=0; i<Time.size(); ++i)
+        {
+            lc.jd[i] = Time[i] / secondsInDay + midpoint;
+        }
+
+        lc.radius = rPlan / rJup;
+        return lc;
+    }
+
     /** Local function only to this file
      
      does the hard number crunching part of the code 
-     so that the other functions can just interface this one */
-    Lightcurve GenerateSyntheticFromParams(const vector<double> &Time, double period, double midpoint, const vector<double> &coeffs, 
-                                           double semi, double rPlan, double rStar, double inclination, double dr, double noise)
+     so that the other functions can just interface this one 
+     
+     If the time array is sorted only the samples inside the transit
+     windows are evaluated, everything else is out of transit */
+    Lightcurve GenerateSyntheticFromParams(const vector<double> &Time, double period, double midpoint, const FluxModel &model, 
+                                           double semi, double rPlan, double rStar, double inclination, double noise,
+                                           const Philox &randGenerator)
     {
         double normalisedDistance = semi / rStar;
         cout << "Normalisation constant: " << normalisedDistance << endl;
-        double omega = calcOmega(coeffs);
         double angFreq = 2. * M_PI / period;
         cout << "Angular frequency: " << angFreq << " rad per sec" << endl;
         
@@ -34,88 +251,60 @@ namespace
         
         const double p = rPlan / rStar;
         
-        /* set up the random number generator */
-        Normaldev_BM randGenerator(0., 1., time(NULL));
-
 
         
         /* Output lightcurve */
-        Lightcurve lc(Time.size());
+        Lightcurve lc(Time.size(), Lightcurve::TimeColumn | Lightcurve::FluxColumn);
         lc.period = period;
         lc.epoch = midpoint;
-        
-        /* parallel process this part */
-#pragma omp parallel for
-        for (unsigned int i=0; i<Time.size(); ++i)
+
+        const double halfWidth = TransitHalfWidth(period, normalisedDistance, p, inclination);
+        vector<IndexRange> windows;
+        if (FindTransitWindows(Time, period, halfWidth, windows))
         {
-            double t = Time.at(i);
-            
-            /* get the normalised device coordinates */
-            double firstTerm = square(sin(angFreq * t));
-            double secondTerm = square(cosi * cos(angFreq * t));
-            
-            
-            
-            
-            double z = normalisedDistance * sqrt(firstTerm + secondTerm);
-            
-            double intpart;
-            double phase = fabs(modf(t  / period , &intpart));
-            phase = phase > 0.5 ? phase - 1.0 : phase;
-            
-            double F = 0;
-            
-            /* Hack to make sure the secondary eclipse is not created */
-            if ((phase > -0.25) && (phase < 0.25))
+            fill(lc.flux.begin(), lc.flux.end(), 1.);
+
+            /* parallel process this part, one transit at a time */
+#pragma omp parallel for schedule(dynamic)
+            for (long w=0; w<(long)windows.size(); ++w)
             {
-                
-                
-                if (z <= 1 - p)
-                {
-                    F = 0.;
-                    //F = 1. - square(p);
-                    double norm = 1. / (4. * z * p);
-                    double integral = IntegratedI(dr, coeffs, z-p, z+p);
-                    integral *= norm;
-                    F = 1. - (square(p) * integral / 4. / omega);
-                }
-                else if (z > 1 + p)
-                {
-                    F = 1.;
-                }
-                else
+                for (size_t i=windows[w].first; i<windows[w].second; ++i)
                 {
-                    double startPoint = z - p;
-                    double a = square(startPoint);
-                    double norm = 1./(1 - a);
-                    
-                    /* Integrate the I*(z) function from startPoint to 1 */
-                    double integral = IntegratedI(dr, coeffs, startPoint, 1.);
-                    integral *= norm;
-                    
-                    double insideSqrt = square(p) - square(z - 1.);
-                    double sqrtVal = sqrt(insideSqrt);
-                    sqrtVal *= (z - 1.);
-                    
-                    double insideAcos = (z - 1.) / p;
-                    double firstTerm = square(p) * acos(insideAcos);
-                    
-                    F = 1. - (integral * (firstTerm - sqrtVal) / (4. * M_PI * omega));
+                    lc.flux[i] = SampleFlux(Time[i], angFreq, cosi, normalisedDistance, period, p, model);
                 }
-                
             }
-            else
+
+            size_t nEvaluated = 0;
+            for (size_t w=0; w<windows.size(); ++w)
             {
-                F = 1.;
+                nEvaluated += windows[w].second - windows[w].first;
             }
-            
+
+            cout << "Evaluated " << nEvaluated << " of " << Time.size() << " samples in "
+                << windows.size() << " transit windows" << endl;
+        }
+        else
+        {
+            /* unsorted time data, evaluate everything */
+#pragma omp parallel for
+            for (long i=0; i<(long)Time.size(); ++i)
+            {
+                lc.flux[i] = SampleFlux(Time[i], angFreq, cosi, normalisedDistance, period, p, model);
+            }
+        }
+        
+        /* the noise only depends on the sample index, not the thread */
+#pragma omp parallel for
+        for (long i=0; i<(long)Time.size(); ++i)
+        {
+            double t = Time[i];
+
             /* add the noise */
-            F += noise * randGenerator.dev();
+            if (noise != 0)
+                lc.flux[i] += noise * randGenerator.Normal(i);
             
             /* append the data to the vectors */
             lc.jd[i] = t / secondsInDay + midpoint;
-            lc.flux[i] = F;
-            
         }
         //outfile.close();
         
@@ -126,6 +315,74 @@ namespace
 
 
     }
+
+    /** Batch version of GenerateSyntheticFromParams for models which only differ in planet radius
+     
+     The separation z is computed once per sample and every radius is evaluated against
+     it. Flux is filled with a contiguous models x samples matrix, row k holding the model
+     for rPlans[k] with noise drawn from randGenerators[k].
+     
+     The transit windows are found for the largest planet so they cover every model */
+    void GenerateSyntheticBatch(const vector<double> &Time, double period, const FluxModel &model,
+                                double semi, const vector<double> &rPlans, double rStar, double inclination, double noise,
+                                const vector<Philox> &randGenerators, ScratchVector &Flux)
+    {
+        const size_t nModels = rPlans.size();
+        const size_t nSamples = Time.size();
+
+        double normalisedDistance = semi / rStar;
+        double angFreq = 2. * M_PI / period;
+        double cosi = cos(inclination);
+
+        vector<double> p(nModels);
+        double pMax = 0;
+        for (size_t k=0; k<nModels; ++k)
+        {
+            p[k] = rPlans[k] / rStar;
+            pMax = max(pMax, p[k]);
+        }
+
+        Flux.assign(nModels * nSamples, 1.);
+
+        const double halfWidth = TransitHalfWidth(period, normalisedDistance, pMax, inclination);
+        vector<IndexRange> windows;
+        if (!FindTransitWindows(Time, period, halfWidth, windows))
+        {
+            /* unsorted time data, evaluate everything */
+            windows.assign(1, IndexRange(0, nSamples));
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (long w=0; w<(long)windows.size(); ++w)
+        {
+            for (size_t i=windows[w].first; i<windows[w].second; ++i)
+            {
+                const double z = SampleSeparation(Time[i], angFreq, cosi, normalisedDistance, period);
+                if (z < 0)
+                    continue;
+
+                for (size_t k=0; k<nModels; ++k)
+                {
+                    Flux[k * nSamples + i] = model.Flux(z, p[k]);
+                }
+            }
+        }
+
+        if (noise != 0)
+        {
+            for (size_t k=0; k<nModels; ++k)
+            {
+                double *row = &Flux[k * nSamples];
+                const Philox &randGenerator = randGenerators[k];
+
+#pragma omp parallel for
+                for (long i=0; i<(long)nSamples; ++i)
+                {
+                    row[i] += noise * randGenerator.Normal(i);
+                }
+            }
+        }
+    }
     
     
     
@@ -138,7 +395,7 @@ namespace
  *
  * \param xmlfilename Name of the input filename
  */
-Lightcurve Application::GenerateModel(const string &xmlfilename)
+Lightcurve Application::GenerateModel(const string &xmlfilename, const unsigned int ModelId)
 {
     /* set up the conversion constants */
     Config::Config config;
@@ -169,6 +426,9 @@ Lightcurve Application::GenerateModel(const string &xmlfilename)
     cout << "Integral step: " << dr * rSun << " m" << endl;
     cout << "Transit mid point: " << midpoint << endl;
     cout << "Simulated noise: " << noise * 100. << "%" << endl;
+    cout << "Flux engine: " << FluxEngine::ToString(config.getEngine()) << endl;
+    if (config.getEngine() == FluxEngine::riemann)
+        cout << "Intensity kernel: " << IntensityKernelName() << endl;
 
 
 
@@ -181,6 +441,9 @@ Lightcurve Application::GenerateModel(const string &xmlfilename)
     /* c0 must be greater than 0. */
     assert(coeffs[0] > 0.);
 
+    /* Flux tables are stored alongside the xml files */
+    const string TableDirectory = boost::filesystem::path(xmlfilename).parent_path().string();
+    const FluxModel model(coeffs, dr, config.getEngine(), config.getTolerance(), TableDirectory);
 
 
 
@@ -188,6 +451,31 @@ Lightcurve Application::GenerateModel(const string &xmlfilename)
 
 
 
+
+    /* a single period on an adaptive phase grid, cheap enough to not need the cache */
+    if (config.getPhaseGrid() == PhaseGrid::adaptive)
+    {
+        vector<double> phase, flux;
+        AdaptivePhaseGrid(period, semi / rStar, rPlan / rStar, inclination, model, config.getPhaseTolerance(), phase, flux);
+        cout << "Adaptive phase grid: " << phase.size() << " samples" << endl;
+
+        /* times within the first period so the phase order is kept */
+        vector<double> time(phase.size());
+        const Philox randGenerator(mSeed, ModelId);
+        for (size_t i=0; i<phase.size(); ++i)
+        {
+            time[i] = (phase[i] < 0 ? phase[i] + 1. : phase[i]) * period;
+
+            if (noise != 0)
+                flux[i] += noise * randGenerator.Normal(i);
+        }
+
+        Lightcurve OutputLightcurve = ModelLightcurve(time, &flux[0], period, midpoint, rPlan);
+        CopyParameters(OutputLightcurve, period, midpoint, rPlan, rStar, inclination, semi);
+
+        return OutputLightcurve;
+    }
+
     /* generate the time array */
     vector<double> time;
 
@@ -201,8 +489,29 @@ Lightcurve Application::GenerateModel(const string &xmlfilename)
     //ofstream outfile("TransitModel.txt");
     //outfile.precision(15);
     
-    /* Now calculate the lightcurve */
-    Lightcurve OutputLightcurve = GenerateSyntheticFromParams(time, period, midpoint, coeffs, semi, rPlan, rStar, inclination, dr, noise);
+    /* Now calculate the lightcurve, unless it has been made before */
+    Lightcurve OutputLightcurve(0);
+    ModelKey CacheKey;
+    vector<double> CachedFlux;
+    if (mCache.get())
+    {
+        CacheKey = ModelCache::MakeKey(CacheParameters(config, mSeed, ModelId), time);
+    }
+
+    if (mCache.get() && mCache->Find(CacheKey, CachedFlux))
+    {
+        cout << "Model found in cache" << endl;
+        OutputLightcurve = ModelLightcurve(time, &CachedFlux[0], period, midpoint, rPlan);
+    }
+    else
+    {
+        OutputLightcurve = GenerateSyntheticFromParams(time, period, midpoint, model, semi, rPlan, rStar, inclination, noise,
+                                                       Philox(mSeed, ModelId));
+        if (mCache.get())
+        {
+            mCache->Store(CacheKey, &OutputLightcurve.flux[0], OutputLightcurve.flux.size());
+        }
+    }
     
     /* Update the lightcurve's parameters */
     CopyParameters(OutputLightcurve, period, midpoint, rPlan, rStar, inclination, semi);
@@ -215,7 +524,7 @@ Lightcurve Application::GenerateModel(const string &xmlfilename)
  The input data set is required to get the phase grid coverage from the data. This way 
  the model only needs to be exactly generated on the data's grid and no errors will be 
  induced into this process */
-Lightcurve Application::GenerateModel(const std::string &xmlfilename, const Lightcurve &SourceData)
+Lightcurve Application::GenerateModel(const std::string &xmlfilename, const Lightcurve &SourceData, const unsigned int ModelId)
 {
     
     /* set up the conversion constants */
@@ -247,6 +556,9 @@ Lightcurve Application::GenerateModel(const std::string &xmlfilename, const Ligh
     cout << "Integral step: " << dr * rSun << " m" << endl;
     cout << "Transit mid point: " << midpoint << endl;
     cout << "Simulated noise: " << noise * 100. << "%" << endl;
+    cout << "Flux engine: " << FluxEngine::ToString(config.getEngine()) << endl;
+    if (config.getEngine() == FluxEngine::riemann)
+        cout << "Intensity kernel: " << IntensityKernelName() << endl;
     
     
     
@@ -258,40 +570,39 @@ Lightcurve Application::GenerateModel(const std::string &xmlfilename, const Ligh
     
     /* c0 must be greater than 0. */
     assert(coeffs[0] > 0.);
+
+    /* Flux tables are stored alongside the xml files */
+    const string TableDirectory = boost::filesystem::path(xmlfilename).parent_path().string();
+    const FluxModel model(coeffs, dr, config.getEngine(), config.getTolerance(), TableDirectory);
     
 
-    /* Need to get the data's time data */
-    vector<double> TimeData = SourceData.jd;
-    /* The time data has to be in seconds */
+    /* Need to get the data's time data in seconds since epoch */
+    const vector<double> TimeData = DataTime(SourceData, midpoint);
+
     
-    /* Need to convert this to time since epoch */
-    const double DataEpoch = midpoint;
-    if (SourceData.asWASP)
-    {
-        /* Data already in seconds so ignore */
-        for (vector<double>::iterator i=TimeData.begin();
-             i!=TimeData.end();
-             ++i)
-        {
-            *i = *i - jd2wd(DataEpoch);
-            
-        }
     
+    Lightcurve OutputLightcurve(0);
+    ModelKey CacheKey;
+    vector<double> CachedFlux;
+    if (mCache.get())
+    {
+        CacheKey = ModelCache::MakeKey(CacheParameters(config, mSeed, ModelId), TimeData);
+    }
+
+    if (mCache.get() && mCache->Find(CacheKey, CachedFlux))
+    {
+        cout << "Model found in cache" << endl;
+        OutputLightcurve = ModelLightcurve(TimeData, &CachedFlux[0], period, midpoint, rPlan);
     }
     else
     {
-        for (vector<double>::iterator i=TimeData.begin();
-             i!=TimeData.end();
-             ++i)
+        OutputLightcurve = GenerateSyntheticFromParams(TimeData, period, midpoint, model, semi, rPlan, rStar, inclination, noise,
+                                                       Philox(mSeed, ModelId));
+        if (mCache.get())
         {
-            *i = (*i - DataEpoch) * secondsInDay;
-            
+            mCache->Store(CacheKey, &OutputLightcurve.flux[0], OutputLightcurve.flux.size());
         }
     }
-
-    
-    
-    Lightcurve OutputLightcurve = GenerateSyntheticFromParams(TimeData, period, midpoint, coeffs, semi, rPlan, rStar, inclination, dr, noise);
     
     /* Update the lightcurve's parameters */
     CopyParameters(OutputLightcurve, period, midpoint, rPlan, rStar, inclination, semi);
@@ -304,3 +615,107 @@ Lightcurve Application::GenerateModel(const std::string &xmlfilename, const Ligh
     return OutputLightcurve;
 }
 
+
+/** Generate a set of models on a data set's time grid
+ 
+ Sweeps generally only vary the planet radius, so the files are grouped by
+ everything else and each group is generated as one batch */
+vector<Lightcurve> Application::GenerateModels(const vector<string> &xmlfilenames, const Lightcurve &SourceData,
+                                               const unsigned int FirstModelId)
+{
+    typedef boost::shared_ptr<Config::Config> ConfigPtr;
+    typedef map<vector<double>, vector<size_t> > GroupMap;
+
+    vector<ConfigPtr> configs;
+    GroupMap groups;
+    for (size_t i=0; i<xmlfilenames.size(); ++i)
+    {
+        ConfigPtr config(new Config::Config);
+        config->LoadFromFile(xmlfilenames[i]);
+        configs.push_back(config);
+
+        groups[GeometryParameters(*config)].push_back(i);
+    }
+
+    vector<Lightcurve> models(xmlfilenames.size(), Lightcurve(0));
+
+    for (GroupMap::const_iterator group=groups.begin(); group!=groups.end(); ++group)
+    {
+        const vector<size_t> &members = group->second;
+        Config::Config &config = *configs[members.front()];
+
+        const double rStar = config.getStarRadius();
+        const double period = config.getPeriod();
+        const double semi = config.getSemi();
+        const double inclination = config.getInclination();
+        const double midpoint = config.getMidpoint();
+        const double noise = config.getNoise();
+        const vector<double> coeffs = config.getCoeffs();
+
+        /* c0 must be greater than 0. */
+        assert(coeffs[0] > 0.);
+
+        const string TableDirectory = boost::filesystem::path(xmlfilenames[members.front()]).parent_path().string();
+        const FluxModel model(coeffs, config.getDR(), config.getEngine(), config.getTolerance(), TableDirectory);
+
+        const vector<double> TimeData = DataTime(SourceData, midpoint);
+
+        /* Anything already in the cache does not need generating */
+        vector<size_t> pending;
+        vector<double> rPlans;
+        vector<Philox> randGenerators;
+        vector<ModelKey> CacheKeys;
+        for (size_t m=0; m<members.size(); ++m)
+        {
+            const size_t i = members[m];
+            const unsigned int ModelId = FirstModelId + i;
+            const double rPlan = configs[i]->getPlanetRadius();
+
+            ModelKey CacheKey;
+            vector<double> CachedFlux;
+            if (mCache.get())
+            {
+                CacheKey = ModelCache::MakeKey(CacheParameters(*configs[i], mSeed, ModelId), TimeData);
+                if (mCache->Find(CacheKey, CachedFlux))
+                {
+                    models[i] = ModelLightcurve(TimeData, &CachedFlux[0], period, midpoint, rPlan);
+                    continue;
+                }
+            }
+
+            pending.push_back(i);
+            rPlans.push_back(rPlan);
+            randGenerators.push_back(Philox(mSeed, ModelId));
+            CacheKeys.push_back(CacheKey);
+        }
+
+        cout << "Generating " << pending.size() << " of " << members.size() << " models with period "
+            << period << " seconds, flux engine " << FluxEngine::ToString(config.getEngine()) << endl;
+
+        if (!pending.empty())
+        {
+            ScratchVector Flux;
+            GenerateSyntheticBatch(TimeData, period, model, semi, rPlans, rStar, inclination, noise, randGenerators, Flux);
+
+            const size_t nSamples = TimeData.size();
+            for (size_t k=0; k<pending.size(); ++k)
+            {
+                const double *row = &Flux[k * nSamples];
+                models[pending[k]] = ModelLightcurve(TimeData, row, period, midpoint, rPlans[k]);
+
+                if (mCache.get())
+                {
+                    mCache->Store(CacheKeys[k], row, nSamples);
+                }
+            }
+        }
+
+        for (size_t m=0; m<members.size(); ++m)
+        {
+            const size_t i = members[m];
+            CopyParameters(models[i], period, midpoint, configs[i]->getPlanetRadius(), rStar, inclination, semi);
+        }
+    }
+
+    return models;
+}
@@ -19,6 +19,7 @@ Lightcurve Application::getObject()
         returnval.jd[i] = hjd[i];
         returnval.fluxerr[i] = fluxerr[i];
     }
+    returnval.UpdateValidity();
 
     /* Get the object id */
     CCfits::Column &ObjIDCol = mInfile->extension("CATALOGUE").column("OBJ_ID");
@@ -5,6 +5,8 @@
 #include <tclap/CmdLine.h>
 #include <sstream>
 #include <fstream>
+#include <ctime>
+#include <algorithm>
 #include <pugixml.hpp>
 
 //#include <glog/logging.h>
@@ -19,12 +21,21 @@
 #include "Application.h"
 #include "Exceptions.h"
 #include "AlterTransit.h"
+#include "ScratchArena.h"
 #include "GetSystemMemory.h"
 #include "CopyFileEfficiently.h"
 #include "ValidXML.h"
 #include "ObjectSkipDefs.h"
 #include "CopyParameters.h"
+#include "Manifest.h"
+#include "Overlay.h"
+#include "FileGrowth.h"
 #include "timer.h"
+#include "config.h"
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 
 
@@ -70,25 +81,104 @@ namespace
         auto_ptr<FITS> pInfile(new FITS(filename, Read));
 
         ExtHDU &CatalogueHDU = pInfile->extension("CATALOGUE");
-        nObjects = CatalogueHDU.rows();
+        nObjects = UsedRows(CatalogueHDU);
 
         return nObjects;
     }
 
-    /** Function to get the object name from an xml file */
-    string ObjectFromXML(const string &xmlfilename)
+    /** Number of synthetics already injected into a file
+     *
+     * Recorded as NSYNTH in the primary header. Files written before the
+     * key existed have the synthetics among their first nRows objects
+     * counted from the SKIPDET flags instead */
+    unsigned int SyntheticCount(FITS &file, long nRows)
     {
-        using namespace pugi;
-        xml_document doc;
-        xml_parse_result result = doc.load_file(xmlfilename.c_str());
-
-        /* Move down the tree until the info -> star -> obj_id -> value is retrieved */
-        string ObjectName = doc.child("info").child("star").child("obj_id").attribute("val").value();
-        return ObjectName;
-
+        long count = 0;
+        try
+        {
+            file.pHDU().readKey("NSYNTH", count);
+            return count;
+        }
+        catch (HDU::NoSuchKeyword &)
+        {
+        }
+
+        if (nRows <= 0)
+            return 0;
+
+        try
+        {
+            vector<int> Skipdet;
+            file.extension("CATALOGUE").column("SKIPDET").read(Skipdet, 1, nRows);
+            return std::count(Skipdet.begin(), Skipdet.end(), static_cast<int>(ad::skipboth));
+        }
+        catch (Table::NoSuchColumn &)
+        {
+            return 0;
+        }
     }
 
+    /** Noise seed for a run adding to the synthetics in filename
+     *
+     * Their noise can only be regenerated, and the new noise streams only
+     * follow on from theirs, with the seed they were made with. That is
+     * the NOISSEED of the file if it holds any synthetics, and a different
+     * -S/--seed is an error. Otherwise the run's own seed is used */
+    unsigned int ContinuedSeed(const string &filename, unsigned int seed, bool SeedGiven)
+    {
+        auto_ptr<FITS> pFile(new FITS(filename, Read));
+        if (!SyntheticCount(*pFile, UsedRows(pFile->extension("CATALOGUE"))))
+            return seed;
+
+        long stored = 0;
+        try
+        {
+            pFile->pHDU().readKey("NOISSEED", stored);
+        }
+        catch (HDU::NoSuchKeyword &)
+        {
+            return seed;
+        }
+
+        const unsigned int StoredSeed = static_cast<unsigned int>(stored);
+        if (SeedGiven && (StoredSeed != seed))
+        {
+            stringstream ss;
+            ss << "The synthetics in " << filename << " were made with noise seed " << StoredSeed
+               << ", -S/--seed must match it";
+            throw UsageError(ss.str());
+        }
+
+        if (StoredSeed != seed)
+        {
+            cout << "Noise seed of the synthetics already in " << filename << ": " << StoredSeed << endl;
+        }
+
+        return StoredSeed;
+    }
 
+    /** Throws unless each host is in the same row of filename as in the index
+     *
+     * An append finds the hosts in the input's index but reads them from
+     * its output, which must be a copy of the input */
+    void CheckHostRows(const string &filename, const ObjectIdIndex &index, const vector<HostJob> &Jobs)
+    {
+        auto_ptr<FITS> pFile(new FITS(filename, Read));
+        ExtHDU &catalogue = pFile->extension("CATALOGUE");
+        const long nObjects = UsedRows(catalogue);
+
+        for (size_t i=0; i<Jobs.size(); ++i)
+        {
+            /*  hosts which are not found are reported when they are looked up */
+            const long row = index.Find(Jobs[i].ObjectName);
+            if (row < 0)
+                continue;
+
+            if ((row >= nObjects) || (ObjectIdIndex::ObjectId(catalogue, row) != Jobs[i].ObjectName))
+                throw UsageError("Object " + Jobs[i].ObjectName + " is not in the same row of " + filename
+                                 + " as in the input, append to a copy of the input");
+        }
+    }
 }
 
 
@@ -108,9 +198,17 @@ int Application::go(int argc, char *argv[])
     TCLAP::ValueArg<float> memlimit_arg("M", "memorylimit", "Fraction of system memory to use", false, 0.1, "0-1", cmd);
     TCLAP::SwitchArg wasptreatment_arg("w", "wasp", "Do not treat as WASP object", cmd, true);
     TCLAP::ValueArg<string> output_arg("o", "output", "Optional output file", false, "synthout.fits", "Fits filename", cmd);
+    TCLAP::ValueArg<int> threads_arg("t", "threads", "Number of threads for the model generation (0 for all)", false, 0, "Threads", cmd);
+    TCLAP::ValueArg<string> cache_arg("c", "cache", "Directory for the model cache", false, "", "Directory", cmd);
+    TCLAP::ValueArg<unsigned int> seed_arg("S", "seed", "Seed for the model noise (default: current time)", false, 0, "Seed", cmd);
     //    TCLAP::ValueArg<string> objectid_arg("O", "object", "Object to alter", true, "", "Object identifier", cmd);
-    TCLAP::ValueArg<string> subModel_arg("s", "submodel", "Model to subtract", true, "", "Model xml file", cmd);
-    TCLAP::ValueArg<string> addModelFilename_arg("a", "addmodels", "List of model files", true, "", "List of files", cmd);
+    TCLAP::ValueArg<string> subModel_arg("s", "submodel", "Model to subtract", false, "", "Model xml file", cmd);
+    TCLAP::ValueArg<string> addModelFilename_arg("a", "addmodels", "List of model files", false, "", "List of files", cmd);
+    TCLAP::SwitchArg overlay_arg("O", "overlay", "Write only the differences from the hosts instead of a copy of the file", cmd, false);
+    TCLAP::SwitchArg append_arg("", "append", "Grow the existing output file instead of copying the input", cmd, false);
+    TCLAP::SwitchArg inplace_arg("", "inplace", "Grow the input file itself, which is changed", cmd, false);
+    TCLAP::ValueArg<int> reserve_arg("", "reserve", "Empty rows left in the copy for later appends", false, 0, "Rows", cmd);
+    TCLAP::ValueArg<string> manifest_arg("m", "manifest", "List of hosts, used instead of -s and -a", false, "", "Manifest file", cmd);
     TCLAP::UnlabeledValueArg<string> filename_arg("file", "File", true, "", "Fits file", cmd);
 
 
@@ -126,6 +224,30 @@ int Application::go(int argc, char *argv[])
     long SystemMemory = getTotalSystemMemory();
 
     cout  << "System memory: " << SystemMemory / 1024. / 1024. << " MB" << endl;
+
+    /*  set up the threading */
+    const int nThreads = threads_arg.getValue();
+    if (nThreads < 0)
+    {
+        throw UsageError("Number of threads must not be negative");
+    }
+#ifdef USE_OPENMP
+    if (nThreads > 0)
+    {
+        omp_set_num_threads(nThreads);
+    }
+    cout << "Using " << omp_get_max_threads() << " threads" << endl;
+#else
+    if (nThreads > 1)
+    {
+        cerr << "Compiled without OpenMP, running with one thread" << endl;
+    }
+#endif
+
+    /*  the noise is reproducible from this seed */
+    mSeed = seed_arg.isSet() ? seed_arg.getValue() : static_cast<unsigned int>(time(NULL));
+    cout << "Noise seed: " << mSeed << endl;
+
     float MemFraction = memlimit_arg.getValue();
 
     /*  make sure this is within the range 0-1 */
@@ -136,8 +258,45 @@ int Application::go(int argc, char *argv[])
 
 
 
-    string ObjectName = ObjectFromXML(subModel_arg.getValue());
-    cout << "Object name: " << ObjectName << endl;
+    /*  models are cached in memory, and on disk if a directory is given */
+    const string CacheDirectory = cache_arg.getValue();
+    if (!CacheDirectory.empty())
+    {
+        bf::create_directories(CacheDirectory);
+        cout << "Caching models in " << CacheDirectory << endl;
+    }
+    mCache = auto_ptr<ModelCache>(new ModelCache(CacheDirectory, size_t(MemFraction * SystemMemory / 4.)));
+
+
+
+    /*  either one host from the command line or a list of them */
+    vector<HostJob> Jobs;
+    if (manifest_arg.isSet())
+    {
+        if (subModel_arg.isSet() || addModelFilename_arg.isSet())
+        {
+            throw UsageError("-m/--manifest cannot be combined with -s/--submodel or -a/--addmodels");
+        }
+
+        Jobs = ReadManifest(manifest_arg.getValue());
+        cout << Jobs.size() << " hosts read from " << manifest_arg.getValue() << endl;
+    }
+    else
+    {
+        if (!subModel_arg.isSet() || !addModelFilename_arg.isSet())
+        {
+            throw UsageError("-s/--submodel and -a/--addmodels are required without -m/--manifest");
+        }
+
+        HostJob Job;
+        Job.SubModel = subModel_arg.getValue();
+        Job.ObjectName = ObjectFromXML(Job.SubModel);
+
+        /*  need to get the path of the models list file */
+        cout << "Using base path: " << bf::path(addModelFilename_arg.getValue()).parent_path() << endl;
+        Job.AddModels = ReadModelList(addModelFilename_arg.getValue());
+        Jobs.push_back(Job);
+    }
 
 
     /*  print if the object is from wasp or not */
@@ -151,45 +310,39 @@ int Application::go(int argc, char *argv[])
         cout << "Non-WASP object chosen" << endl;
     }
 
+    /*  the output is either a new file, an existing one grown in place
+     *  or an overlay */
+    const bool GrowFile = append_arg.isSet() || inplace_arg.isSet();
+    if (append_arg.isSet() && inplace_arg.isSet())
+    {
+        throw UsageError("--append and --inplace cannot be combined");
+    }
+    if (GrowFile && overlay_arg.isSet())
+    {
+        throw UsageError("-O/--overlay cannot be combined with --append or --inplace");
+    }
+    if (reserve_arg.isSet() && (GrowFile || overlay_arg.isSet() || (reserve_arg.getValue() < 0)))
+    {
+        throw UsageError("--reserve takes a number of rows and only applies when the file is copied");
+    }
+
     /*  need to get the number of objects that were originally in the 
      *  file so we know which index to add the nExtra objects at */
-    const int nObjects = getNObjects(filename_arg.getValue());
+    int nObjects = getNObjects(filename_arg.getValue());
 
     /*  string for storing the filename */
-    string DataFilename = output_arg.getValue();
+    string DataFilename = inplace_arg.isSet() ? filename_arg.getValue() : output_arg.getValue();
     timer.stop("config");
 
 
-    /*  need to get the list of extra models to add */
+    /*  need to get the list of extra models to add, the rows for every
+     *  host are added by the one copy */
     int nExtra = 0;
-
-
-    StringList AddModelFilenames;
-
-    /*  need to get the path of the models list file */
-    bf::path BasePath = bf::path(addModelFilename_arg.getValue()).parent_path();
-    cout << "Using base path: " << BasePath << endl;
-
-
-
-
-    ifstream ModelsListFile(addModelFilename_arg.getValue().c_str());
-    if (!ModelsListFile.is_open())
+    for (size_t i=0; i<Jobs.size(); ++i)
     {
-        throw FileNotOpen("Cannot open list of model files for reading");
+        nExtra += Jobs[i].AddModels.size();
     }
 
-    string line;
-    while (getline(ModelsListFile, line))
-    {
-        bf::path FullPath = BasePath / bf::path(line);
-
-
-        AddModelFilenames.push_back(FullPath.string());
-        nExtra++;
-    }
-
-
     cout << nExtra << " lightcurves will be appended to the file" << endl;
 
 
@@ -199,87 +352,109 @@ int Application::go(int argc, char *argv[])
 
 
 
-    /*  now copy the file across */
-    /*  exclamation mark ensures the file is overwritten if it exists */
-    timer.start("filecopy");
-    CopyFileEfficiently(filename_arg.getValue(), nExtra, "!" + DataFilename, MemFraction);
-    timer.stop("filecopy");
-
-    /*  open the fits file */
-    timer.start("update");
-    mInfile = auto_ptr<FITS>(new FITS(DataFilename, Write));
-    fptr = mInfile->fitsPointer();
-
-    /*  get the desired index */
-    mObjectIndex = ObjectIndex(ObjectName);
-
-    /*  need to update the object's skipdet column value */
-    vector<unsigned int> SkipdetData(1, ad::skiptfa);
-    mInfile->extension("CATALOGUE").column("SKIPDET").write(SkipdetData, mObjectIndex+1);
+    /*  the hosts are looked up in the source file's index, which is
+     *  built on the first run and loaded afterwards */
+    mObjectIdIndex = auto_ptr<ObjectIdIndex>(new ObjectIdIndex(filename_arg.getValue()));
 
-    /*  extract the flux */
-    Lightcurve ChosenObject = getObject();
-
-    if (asWASP)
+    if (overlay_arg.isSet())
+    {
+        /*  the source is only read, the synthetics go to the overlay */
+        timer.start("update");
+        mInfile = auto_ptr<FITS>(new FITS(filename_arg.getValue(), Read));
+        fptr = mInfile->fitsPointer();
+
+        const long nFrames = mInfile->extension("FLUX").axis(0);
+        mOverlay = auto_ptr<OverlayWriter>(new OverlayWriter(DataFilename, filename_arg.getValue(), nFrames, mSeed));
+        cout << "Writing overlay " << DataFilename << endl;
+    }
+    else if (GrowFile)
     {
-        ChosenObject.asWASP = true;
+        /*  only the new rows are written, an interrupted earlier append
+         *  is rolled back first */
+        timer.start("filecopy");
+        mGrowth = auto_ptr<FileGrowth>(new FileGrowth(DataFilename));
+        mSeed = ContinuedSeed(DataFilename, mSeed, seed_arg.isSet());
+        if (append_arg.isSet())
+        {
+            CheckHostRows(DataFilename, *mObjectIdIndex, Jobs);
+        }
+        nObjects = mGrowth->Grow(nExtra);
+        timer.stop("filecopy");
+
+        timer.start("update");
+        mInfile = auto_ptr<FITS>(new FITS(DataFilename, Write));
+        fptr = mInfile->fitsPointer();
+
+        mInfile->pHDU().addKey("NOISSEED", static_cast<long>(mSeed), "Seed for the synthetic noise");
     }
     else
     {
-        ChosenObject.asWASP = false;
+        /*  now copy the file across */
+        /*  exclamation mark ensures the file is overwritten if it exists */
+        timer.start("filecopy");
+        mSeed = ContinuedSeed(filename_arg.getValue(), mSeed, seed_arg.isSet());
+        CopyFileEfficiently(filename_arg.getValue(), nExtra, "!" + DataFilename, MemFraction, reserve_arg.getValue());
+        timer.stop("filecopy");
+
+        /*  open the fits file */
+        timer.start("update");
+        mInfile = auto_ptr<FITS>(new FITS(DataFilename, Write));
+        fptr = mInfile->fitsPointer();
+
+        /*  record the seed so the noise can be regenerated */
+        mInfile->pHDU().addKey("NOISSEED", static_cast<long>(mSeed), "Seed for the synthetic noise");
     }
 
-    /*  need a subtraction model whatever happens */
-    Lightcurve SubModel = GenerateModel(subModel_arg.getValue(), ChosenObject);
-
-
-    /*  update the period and epoch */
-    ChosenObject.period = SubModel.period;
-    ChosenObject.epoch = SubModel.epoch;
-
-
-    SubModel.asWASP = false;
-
-    Lightcurve LCRemoved = RemoveTransit(ChosenObject, SubModel);
-    LCRemoved.asWASP = ChosenObject.asWASP;
-
-
-    /*  now need to iterate through the list of filenames generating 
-     *  a new object every time 
-     *
-     *  TODO: This will generate a lot of output if the code remains as it is 
-     *  so this may need altering */
-
-    int count = 0;
-
-    ExtHDU &FluxHDU = mInfile->extension("FLUX");
-    const int nFrames = FluxHDU.axis(0);
-    for (StringList::iterator i=AddModelFilenames.begin();
-            i!=AddModelFilenames.end();
-            ++i, ++count)
+    /*  the noise streams carry on after any synthetics already in the
+     *  file, which is recorded for the next run. An overlay only holds
+     *  its own */
+    unsigned int ModelCount = 0;
+    if (!mOverlay.get())
     {
-        const int InsertIndex = nObjects + count;
-        cout << "Using model file: " << *i << endl;
-        CopyObject(InsertIndex);
-
-        Lightcurve AddModel = GenerateModel(*i, LCRemoved);
-
-        AddModel.asWASP = false;
-        //LCRemoved.period = AddModel.period;
-        //LCRemoved.epoch = AddModel.epoch;
-        CopyParameters(AddModel, LCRemoved);
-        Lightcurve SyntheticLightcurve = AddTransit(LCRemoved, AddModel);
-        CopyParameters(LCRemoved, SyntheticLightcurve);
-        //SyntheticLightcurve.radius = AddModel.radius;
+        ModelCount = SyntheticCount(*mInfile, nObjects);
+        mInfile->pHDU().addKey("NSYNTH", static_cast<long>(ModelCount + nExtra), "Synthetics injected so far");
+    }
 
-        /*  set the data to the new value */
-        UpdateFile(SyntheticLightcurve, InsertIndex);
+    /*  the hosts are visited in the order they appear in the file so the
+     *  reads of their strips move forward through it. Each host's noise
+     *  streams follow the manifest order so do not depend on the file */
+    vector<pair<int, size_t> > HostOrder;
+    vector<unsigned int> FirstModelIds;
+    for (size_t i=0; i<Jobs.size(); ++i)
+    {
+        HostOrder.push_back(make_pair(ObjectIndex(Jobs[i].ObjectName), i));
+        FirstModelIds.push_back(ModelCount + 1);
+        ModelCount += Jobs[i].AddModels.size();
+    }
+    stable_sort(HostOrder.begin(), HostOrder.end());
 
+    /*  models sharing their geometry are generated together, as many at 
+     *  a time as fit in a quarter of the allowed memory along with their
+     *  synthetic lightcurves and temporary buffers */
+    const double BatchMemory = MemFraction * SystemMemory / 4.;
+    const int nFrames = mInfile->extension("FLUX").axis(0);
 
+    /*  temporary buffers (sorting, interpolation, batch flux) come from per
+     *  thread arenas which are reset after each batch */
+    ScratchArenas Scratch(static_cast<size_t>(4. * sizeof(double) * max(nFrames, 1)));
 
+    int InsertIndex = nObjects;
+    for (size_t i=0; i<HostOrder.size(); ++i)
+    {
+        const HostJob &Job = Jobs[HostOrder[i].second];
+        mObjectIndex = HostOrder[i].first;
 
+        InjectHost(Job, InsertIndex, FirstModelIds[HostOrder[i].second], BatchMemory, asWASP, Scratch);
+        InsertIndex += Job.AddModels.size();
+    }
 
+    cout << "Scratch memory peak: " << Scratch.peak() / 1024. / 1024. << " MB" << endl;
 
+    if (mGrowth.get())
+    {
+        /*  everything is on disk once the file is closed */
+        mInfile.reset();
+        mGrowth->Commit();
     }
 
 
@@ -291,6 +466,8 @@ int Application::go(int argc, char *argv[])
     timer.stop("update");
     timer.stop("all");
 
+    cout << "Model cache: " << mCache->hits() << " hits, " << mCache->misses() << " misses" << endl;
+
 
 
 
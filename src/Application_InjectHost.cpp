@@ -0,0 +1,174 @@
+#include "Application.h"
+#include "AlterTransit.h"
+#include "HostContext.h"
+#include "ScratchArena.h"
+#include "ObjectSkipDefs.h"
+#include "Overlay.h"
+#include "FileGrowth.h"
+#include "ModelSampler.h"
+#include "XMLParserPugi.h"
+#include <algorithm>
+
+using namespace std;
+using namespace CCfits;
+namespace ad = AlterDetrending;
+
+namespace
+{
+    /** Noise level of a model config, an overlay regenerates the noise */
+    double ConfigNoise(const string &xmlfilename)
+    {
+        Config::Config config;
+        config.LoadFromFile(xmlfilename);
+        return config.getNoise();
+    }
+}
+
+/** Injects every synthetic of one host
+ *
+ * The host at mObjectIndex has its transit removed and the synthetics
+ * are written to the consecutive rows starting at FirstIndex */
+void Application::InjectHost(const HostJob &Job, const int FirstIndex, const unsigned int FirstModelId,
+                             const double BatchMemory, const bool asWASP, ScratchArenas &Scratch)
+{
+    cout << "Object name: " << Job.ObjectName << endl;
+
+    /*  need to update the object's skipdet column value, an overlay
+     *  leaves the source untouched */
+    if (!mOverlay.get())
+    {
+        Column &SkipdetCol = mInfile->extension("CATALOGUE").column("SKIPDET");
+
+        /*  a grown file gets its original flag back if the run is rolled back */
+        if (mGrowth.get())
+        {
+            vector<int> Original;
+            SkipdetCol.read(Original, mObjectIndex+1, mObjectIndex+1);
+            mGrowth->RecordSkipdet(mObjectIndex, Original[0]);
+        }
+
+        vector<unsigned int> SkipdetData(1, ad::skiptfa);
+        SkipdetCol.write(SkipdetData, mObjectIndex+1);
+    }
+
+    /*  extract the flux */
+    Lightcurve ChosenObject = getObject();
+
+    if (asWASP)
+    {
+        ChosenObject.asWASP = true;
+    }
+    else
+    {
+        ChosenObject.asWASP = false;
+    }
+
+    /*  need a subtraction model whatever happens, with noise of its own
+     *  so the hosts of a field do not share it */
+    const unsigned int SubModelId = SubModelStreams + mObjectIndex;
+    Lightcurve SubModel = GenerateModel(Job.SubModel, ChosenObject, SubModelId);
+
+
+    /*  update the period and epoch */
+    ChosenObject.period = SubModel.period;
+    ChosenObject.epoch = SubModel.epoch;
+
+
+    SubModel.asWASP = false;
+
+    Lightcurve LCRemoved = RemoveTransit(ChosenObject, SubModel);
+    LCRemoved.asWASP = ChosenObject.asWASP;
+
+
+    /*  now need to iterate through the list of filenames generating
+     *  a new object every time
+     *
+     *  TODO: This will generate a lot of output if the code remains as it is
+     *  so this may need altering */
+
+    ExtHDU &FluxHDU = mInfile->extension("FLUX");
+    const int nFrames = FluxHDU.axis(0);
+
+    /*  everything the injection needs from the host is worked out once */
+    HostContext Host(LCRemoved);
+
+    /*  an overlay rebuilds the frames outside the transits from these */
+    OverlayRecipe Recipe;
+    if (mOverlay.get())
+    {
+        Recipe.HostMean = MeanFlux(ChosenObject);
+        Recipe.RemovedMean = Host.mean();
+        Recipe.SubNoise = ConfigNoise(Job.SubModel);
+        Recipe.SubModelId = SubModelId;
+    }
+
+    /*  models sharing their geometry are generated together, as many at
+     *  a time as fit in the batch memory along with their synthetic
+     *  lightcurves and temporary buffers */
+    const vector<string> &ModelFilenames = Job.AddModels;
+    /*  models hold time and flux, the synthetic lightcurves all three
+     *  columns, and each synthetic takes a row of the buffer staging its
+     *  image rows for writing */
+    const double RowBytes = sizeof(double) * max(nFrames, 1);
+    const double ModelBytes = 6. * RowBytes;
+
+    /*  the initial estimate of the temporary buffers per model is replaced
+     *  by the measured use as the batches run */
+    double ScratchBytes = 4. * sizeof(double) * max(nFrames, 1);
+    size_t BatchSize = max(size_t(1), size_t(BatchMemory / (ModelBytes + ScratchBytes)));
+
+    /*  kept between batches so the synthetic lightcurves reuse their columns */
+    vector<Lightcurve> SyntheticLightcurves;
+
+    for (size_t first=0; first<ModelFilenames.size(); )
+    {
+        const size_t last = min(first + BatchSize, ModelFilenames.size());
+        const vector<string> BatchFilenames(ModelFilenames.begin() + first, ModelFilenames.begin() + last);
+        vector<Lightcurve> AddModels = GenerateModels(BatchFilenames, LCRemoved, FirstModelId + first);
+
+        for (size_t k=0; k<AddModels.size(); ++k)
+        {
+            AddModels[k].asWASP = false;
+        }
+
+        Host.Inject(AddModels, SyntheticLightcurves);
+
+        for (size_t count=first; count<last; ++count)
+        {
+            cout << "Using model file: " << ModelFilenames[count] << endl;
+        }
+
+        if (mOverlay.get())
+        {
+            /*  only the frames inside the transits are kept */
+            for (size_t k=0; k<SyntheticLightcurves.size(); ++k)
+            {
+                Recipe.AddNoise = ConfigNoise(ModelFilenames[first + k]);
+                Recipe.ModelId = FirstModelId + first + k;
+                mOverlay->Add(mObjectIndex, ChosenObject, Recipe, SubModel, AddModels[k], SyntheticLightcurves[k]);
+            }
+            mOverlay->Flush();
+        }
+        else
+        {
+            /*  the batch occupies consecutive rows so each column and image is
+             *  written in one go, the flux is not copied as it is replaced
+             *  straight away. The staging buffers only get the row per
+             *  model counted in the batch size */
+            const double StagingBytes = (last - first) * RowBytes;
+            CopyCatalogueRows(FirstIndex + first, last - first);
+            CopyImageRows(FirstIndex + first, last - first, false, StagingBytes);
+
+            /*  set the data to the new value */
+            WriteFluxRows(SyntheticLightcurves, FirstIndex + first, StagingBytes);
+            UpdateCatalogue(SyntheticLightcurves, FirstIndex + first);
+        }
+        vector<Lightcurve>().swap(AddModels);
+
+        /*  every temporary buffer of the batch is gone */
+        ScratchBytes = max(ScratchBytes, Scratch.used() / double(last - first));
+        Scratch.Reset();
+        BatchSize = max(size_t(1), size_t(BatchMemory / (ModelBytes + ScratchBytes)));
+        first = last;
+    }
+}
@@ -0,0 +1,143 @@
+#include "CatalogueBuffer.h"
+#include "ModelSampler.h"
+#include "constants.h"
+#include "WaspDateConverter.h"
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+
+using namespace std;
+using namespace CCfits;
+
+namespace
+{
+    int NCHARS = 26;
+
+    vector<string> &split(const string &s, char delim, vector<string> &elems) {
+        stringstream ss(s);
+        string item;
+        while(getline(ss, item, delim)) {
+            elems.push_back(item);
+        }
+        return elems;
+    }
+
+
+    vector<string> split(const string &s, char delim) {
+        vector<string> elems;
+        return split(s, delim, elems);
+    }
+
+
+    /** Function to change the wasp id to something unique */
+    string ChangeName(const string &obj_id)
+    {
+        /* Split the string at the character J to get the coordinates */
+        vector<string> IDParts = split(obj_id, 'J');
+
+        /* Check that 2 parts are returned */
+        if (IDParts.size() != 2)
+        {
+            throw runtime_error("Invalid WASP id passed");
+        }
+
+        const string &Coords = IDParts[1];
+
+
+        stringstream ss;
+        ss << "1SYNTH J" << Coords;
+
+        string NewName = ss.str();
+
+        /* Check that there are no remaining characters */
+        if ((NCHARS - (int)NewName.size()) < 0)
+        {
+            throw runtime_error("Invalid name constructed - will not fit into column");
+        }
+
+
+        return NewName;
+    }
+
+    double WidthFromParams(const Lightcurve &lc)
+    {
+        /* Returns the width of the full transit based on some lc parameters
+         *
+         * \frac{P}{\pi} \asin{\sqrt{(\frac{R_P + R_S}{a})^2 - \cos^2 i}}
+         */
+        const double Norm = lc.period / M_PI;
+        if (lc.sep == 0)
+        {
+            /* Something hasn't updated the separation */
+            return 0;
+        }
+
+        double FirstTerm = (lc.radius + lc.rstar) / lc.sep;
+
+        /* Square it */
+        FirstTerm *= FirstTerm;
+
+        const double InsideSqrt = FirstTerm - cos(lc.inclination);
+        return Norm * asin(sqrt(InsideSqrt));
+
+    }
+}
+
+void CatalogueBuffer::Append(const Lightcurve &lc, unsigned int skipdet)
+{
+    FluxMean.push_back(MeanFlux(lc));
+
+    /* Use the new name, probably using ngts file if it cannot be
+     * made so keep the original identifier */
+    try
+    {
+        ObjID.push_back(ChangeName(lc.obj_id));
+    }
+    catch (runtime_error &e)
+    {
+        ObjID.push_back(lc.obj_id);
+    }
+
+    Radius.push_back(lc.radius);
+    RStar.push_back(lc.rstar);
+    Period.push_back(lc.period);
+    Sep.push_back(lc.sep);
+    Inclination.push_back(lc.inclination * degreesInRadian);
+    Epoch.push_back(jd2wd(lc.epoch));
+
+    /* Calculate the depth */
+    Depth.push_back((lc.radius / lc.rstar) * (lc.radius / lc.rstar));
+
+    /* and the width */
+    Width.push_back(WidthFromParams(lc));
+
+    Skipdet.push_back(skipdet);
+}
+
+void CatalogueBuffer::Write(ExtHDU &CatalogueHDU, int FirstIndex) const
+{
+    const int FirstRow = FirstIndex + 1;
+    CatalogueHDU.column("FLUX_MEAN").write(FluxMean, FirstRow);
+
+    try
+    {
+        CatalogueHDU.column("OBJ_ID").write(ObjID, FirstRow);
+    }
+    catch (Column::WrongColumnType &e)
+    {
+        /*  didn't work, probably working on NGTS prototype data so ignore */
+    }
+
+    /* Now update the catalogue fake- columns */
+    CatalogueHDU.column("FAKE_RP").write(Radius, FirstRow);
+    CatalogueHDU.column("FAKE_RS").write(RStar, FirstRow);
+    CatalogueHDU.column("FAKE_PERIOD").write(Period, FirstRow);
+    CatalogueHDU.column("FAKE_A").write(Sep, FirstRow);
+    CatalogueHDU.column("FAKE_I").write(Inclination, FirstRow);
+    CatalogueHDU.column("FAKE_EPOCH").write(Epoch, FirstRow);
+    CatalogueHDU.column("FAKE_DEPTH").write(Depth, FirstRow);
+    CatalogueHDU.column("FAKE_WIDTH").write(Width, FirstRow);
+
+    /* need to update the skipdet column */
+    CatalogueHDU.column("SKIPDET").write(Skipdet, FirstRow);
+}
@@ -1,9 +1,19 @@
 #include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
 #include <CCfits/CCfits>
 
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 /*  local includes */
 #include "GetSystemMemory.h"
 #include "Exceptions.h"
+#include "ImageCopyPipeline.h"
+#include "CopyFileEfficiently.h"
+#include "ObjectSkipDefs.h"
 
 using namespace CCfits;
 using namespace std;
@@ -11,12 +21,268 @@ using namespace std;
 typedef map<string, Column*> ColumnMap;
 typedef vector<string> StringVector;
 
+namespace ad = AlterDetrending;
+
+/*  copy_file_range appeared in glibc 2.27 */
+#if defined(__linux__) && defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 27)))
+#define HAVE_COPY_FILE_RANGE
+#endif
+
+namespace
+{
+    /** Image whose existing data is copied byte for byte */
+    struct RawImage
+    {
+        string name;
+        long bitpix;
+    };
+
+    /** Path of a plain file given to cfitsio, empty if it is anything else
+     
+     The leading ! (overwrite) is dropped. Extended file names and files
+     cfitsio compresses or decompresses on the fly cannot be copied raw */
+    string PlainPath(const string &Filename)
+    {
+        const string path = (!Filename.empty() && Filename[0] == '!') ? Filename.substr(1) : Filename;
+
+        if (path.empty() || (path.find_first_of("[]") != string::npos) || (path.find("://") != string::npos))
+            return "";
+
+        const char *compressed[] = { ".gz", ".Z", ".zip", ".bz2" };
+        for (size_t i=0; i<sizeof(compressed) / sizeof(compressed[0]); ++i)
+        {
+            const string suffix = compressed[i];
+            if ((path.size() > suffix.size()) && (path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0))
+                return "";
+        }
+
+        return path;
+    }
+
+    /** True if the file on disk is a FITS file as cfitsio sees it, not compressed */
+    bool IsPlainFits(const string &path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        char start[9];
+        const bool plain = (pread(fd, start, sizeof(start), 0) == (ssize_t)sizeof(start))
+            && (memcmp(start, "SIMPLE  =", sizeof(start)) == 0);
+        close(fd);
+        return plain;
+    }
+
+    /** True if the current image of fptr stores its values unscaled and uncompressed
+     
+     Only then are the bytes in the output, which has no BSCALE or BZERO,
+     the same as in the input */
+    bool StoredUnscaled(fitsfile *fptr)
+    {
+        int status = 0;
+        if (fits_is_compressed_image(fptr, &status) || status)
+            return false;
+
+        double bscale = 1, bzero = 0;
+        fits_read_key(fptr, TDOUBLE, "BSCALE", &bscale, NULL, &status);
+        if (status == KEY_NO_EXIST)
+        {
+            bscale = 1;
+            status = 0;
+        }
+
+        fits_read_key(fptr, TDOUBLE, "BZERO", &bzero, NULL, &status);
+        if (status == KEY_NO_EXIST)
+        {
+            bzero = 0;
+            status = 0;
+        }
+
+        return !status && (bscale == 1) && (bzero == 0);
+    }
+
+    /** Offset of the data unit of the named image */
+    off_t DataStart(fitsfile *fptr, const string &name)
+    {
+        int status = 0;
+        fits_movnam_hdu(fptr, IMAGE_HDU, const_cast<char*>(name.c_str()), 0, &status);
+
+        LONGLONG headstart = 0, datastart = 0, dataend = 0;
+        fits_get_hduaddrll(fptr, &headstart, &datastart, &dataend, &status);
+        if (status) throw FitsioException(status);
+
+        return datastart;
+    }
+
+    /** Copies nBytes between two open files, in kernel if possible */
+    void CopyBytes(int in, off_t inOffset, int out, off_t outOffset, size_t nBytes, size_t BufferSize)
+    {
+#ifdef HAVE_COPY_FILE_RANGE
+        /*  the kernel copies (or shares, on filesystems with reflinks) the
+            blocks without them passing through user space */
+        while (nBytes > 0)
+        {
+            loff_t inPos = inOffset, outPos = outOffset;
+            const ssize_t copied = copy_file_range(in, &inPos, out, &outPos, nBytes, 0);
+            if (copied <= 0)
+                break;
+
+            inOffset += copied;
+            outOffset += copied;
+            nBytes -= copied;
+        }
+#endif
+
+        /*  anything left (other filesystems, old kernels) goes through a buffer */
+        vector<char> buffer(min(nBytes, BufferSize));
+        while (nBytes > 0)
+        {
+            const ssize_t nRead = pread(in, &buffer[0], min(nBytes, buffer.size()), inOffset);
+            if (nRead <= 0)
+                throw FileCopyError(string("Cannot read the input file: ") + strerror(errno));
+
+            for (ssize_t written=0; written<nRead; )
+            {
+                const ssize_t nWritten = pwrite(out, &buffer[written], nRead - written, outOffset + written);
+                if (nWritten <= 0)
+                    throw FileCopyError(string("Cannot write the output file: ") + strerror(errno));
+
+                written += nWritten;
+            }
+
+            inOffset += nRead;
+            outOffset += nRead;
+            nBytes -= nRead;
+        }
+    }
+
+    /** Copies the first N values of each image from the input to the output data units
+     
+     Both files must be closed by CCfits first so the output data units
+     exist at their final positions */
+    void CopyRawImages(const string &InPath, const string &OutPath, const vector<RawImage> &Images, long N, float MemLimit)
+    {
+        int status = 0;
+        fitsfile *infptr = 0, *outfptr = 0;
+        fits_open_file(&infptr, InPath.c_str(), READONLY, &status);
+        fits_open_file(&outfptr, OutPath.c_str(), READONLY, &status);
+        if (status) throw FitsioException(status);
+
+        vector<off_t> inStarts, outStarts;
+        for (size_t i=0; i<Images.size(); ++i)
+        {
+            inStarts.push_back(DataStart(infptr, Images[i].name));
+            outStarts.push_back(DataStart(outfptr, Images[i].name));
+        }
+
+        fits_close_file(infptr, &status);
+        fits_close_file(outfptr, &status);
+        if (status) throw FitsioException(status);
+
+        const int in = open(InPath.c_str(), O_RDONLY);
+        const int out = open(OutPath.c_str(), O_WRONLY);
+        if ((in < 0) || (out < 0))
+        {
+            if (in >= 0) close(in);
+            if (out >= 0) close(out);
+            throw FileCopyError("Cannot open the files for copying: " + InPath + ", " + OutPath);
+        }
+
+        try
+        {
+            for (size_t i=0; i<Images.size(); ++i)
+            {
+                const size_t nBytes = size_t(N) * (labs(Images[i].bitpix) / 8);
+                cout << "Copying the " << Images[i].name << " data directly, " << nBytes / 1024. / 1024. << " MB" << endl;
+                CopyBytes(in, inStarts[i], out, outStarts[i], nBytes, max(size_t(MemLimit), size_t(1 << 20)));
+            }
+        }
+        catch (...)
+        {
+            close(in);
+            close(out);
+            throw;
+        }
+
+        close(in);
+        if (close(out) != 0)
+            throw FileCopyError(string("Cannot write the output file: ") + strerror(errno));
+    }
+}
+
+
+void SyntheticColumns(StringVector &names, StringVector &formats, StringVector &units)
+{
+    /* Need to add the skipdet column */
+    names.push_back("SKIPDET");
+    formats.push_back("1I");
+    units.push_back("");
+
+    /* Also add the fake transits columns
+     *
+     * need:
+     *  rplanet
+     *  rstar
+     *  -> depth
+     *  separation
+     *  inclination
+     *  period (sec)
+     *  -> width (sec)
+     *  -> epoch (sec)
+     *
+     * */
+
+    /* Start with the already defined ones */
+    names.push_back("FAKE_PERIOD");
+    names.push_back("FAKE_WIDTH");
+    names.push_back("FAKE_DEPTH");
+    names.push_back("FAKE_EPOCH");
+
+    formats.push_back("1D");
+    formats.push_back("1D");
+    formats.push_back("1D");
+    formats.push_back("1J");
+
+    units.push_back("sec");
+    units.push_back("sec");
+    units.push_back("");
+    units.push_back("sec");
+
+    /* And now the extra ones */
+    names.push_back("FAKE_RP");
+    names.push_back("FAKE_RS");
+    names.push_back("FAKE_A");
+    names.push_back("FAKE_I");
+
+    formats.push_back("1D");
+    formats.push_back("1D");
+    formats.push_back("1D");
+    formats.push_back("1D");
+
+    units.push_back("m");
+    units.push_back("m");
+    units.push_back("m");
+    units.push_back("deg");
+}
 
-/*  forward declaration */
-template <typename T>
-void CopyImageData(ExtHDU &InHDU, ExtHDU &OutHDU, fitsfile *infptr, fitsfile *outfptr, float MemLimit);
 
-void CopyFileEfficiently(const string &Filename, const int nExtra, const string &OutputFilename, const float fraction)
+long UsedRows(ExtHDU &catalogue)
+{
+    long nRows = catalogue.rows();
+    try
+    {
+        catalogue.readKey("ROWSUSED", nRows);
+    }
+    catch (HDU::NoSuchKeyword &)
+    {
+    }
+
+    return nRows;
+}
+
+
+void CopyFileEfficiently(const string &Filename, const int nExtra, const string &OutputFilename, const float fraction,
+                         const int nReserve)
 {
     map<int, string> ImageTypes;
     ImageTypes[8] = "Unsigned integer";
@@ -38,6 +304,12 @@ void CopyFileEfficiently(const string &Filename, const int nExtra, const string
     
 
 
+    /*  unchanged image data can be copied byte for byte if both files are
+     *  plain FITS files on disk */
+    const string InPath = PlainPath(Filename), OutPath = PlainPath(OutputFilename);
+    const bool RawPossible = !InPath.empty() && !OutPath.empty() && IsPlainFits(InPath);
+    vector<RawImage> RawImages;
+
     auto_ptr<FITS> pInfile(new FITS(Filename.c_str(), Read));
 
     /*  this constructor copies the primary hdu across
@@ -53,7 +325,8 @@ void CopyFileEfficiently(const string &Filename, const int nExtra, const string
     ExtHDU &CatalogueHDU = pInfile->extension("CATALOGUE");
     ExtHDU &ImagelistHDU = pInfile->extension("IMAGELIST");
 
-    const long nObjects = CatalogueHDU.rows();
+    /*  reserved rows of the input are not copied */
+    const long nObjects = UsedRows(CatalogueHDU);
     const long nFrames = ImagelistHDU.rows();
     cout << nObjects << " objects found" << endl;
     cout << nFrames << " frames found" << endl;
@@ -61,6 +334,10 @@ void CopyFileEfficiently(const string &Filename, const int nExtra, const string
     const long nTotal = nObjects + nExtra;
 
     cout << nExtra << " objects will be appended making a total of " << nTotal << " objects" << endl;
+    if (nReserve > 0)
+    {
+        cout << nReserve << " empty rows will be reserved for later appends" << endl;
+    }
 
     /*  creating the Catalogue HDU */
     /*  ******************************************************************************** */
@@ -77,60 +354,21 @@ void CopyFileEfficiently(const string &Filename, const int nExtra, const string
         ColumnUnits.push_back(i->second->unit());
     }
 
-    /* Need to add the skipdet column */
-    ColumnNames.push_back("SKIPDET");
-    ColumnFormats.push_back("1I");
-    ColumnUnits.push_back("");
-
-    /* Also add the fake transits columns
-     *
-     * need:
-     *  rplanet
-     *  rstar
-     *  -> depth
-     *  separation
-     *  inclination
-     *  period (sec)
-     *  -> width (sec)
-     *  -> epoch (sec)
-     *
-     * */
-
-    /* Start with the already defined ones */
-    ColumnNames.push_back("FAKE_PERIOD");
-    ColumnNames.push_back("FAKE_WIDTH");
-    ColumnNames.push_back("FAKE_DEPTH");
-    ColumnNames.push_back("FAKE_EPOCH");
+    /* Need to add the skipdet and fake transit columns */
+    SyntheticColumns(ColumnNames, ColumnFormats, ColumnUnits);
 
-    ColumnFormats.push_back("1D");
-    ColumnFormats.push_back("1D");
-    ColumnFormats.push_back("1D");
-    ColumnFormats.push_back("1J");
 
-    ColumnUnits.push_back("sec");
-    ColumnUnits.push_back("sec");
-    ColumnUnits.push_back("");
-    ColumnUnits.push_back("sec");
-
-    /* And now the extra ones */
-    ColumnNames.push_back("FAKE_RP");
-    ColumnNames.push_back("FAKE_RS");
-    ColumnNames.push_back("FAKE_A");
-    ColumnNames.push_back("FAKE_I");
-
-    ColumnFormats.push_back("1D");
-    ColumnFormats.push_back("1D");
-    ColumnFormats.push_back("1D");
-    ColumnFormats.push_back("1D");
-
-    ColumnUnits.push_back("m");
-    ColumnUnits.push_back("m");
-    ColumnUnits.push_back("m");
-    ColumnUnits.push_back("deg");
+    /*  create the new hdu */
+    Table *NewCatalogueHDU = pOutfile->addTable("CATALOGUE", nTotal + nReserve, ColumnNames, ColumnFormats, ColumnUnits);
 
+    /*  the reserved rows are skipped by the detrending until they are filled */
+    if (nReserve > 0)
+    {
+        NewCatalogueHDU->addKey("ROWSUSED", nTotal, "Catalogue rows holding objects");
 
-    /*  create the new hdu */
-    Table *NewCatalogueHDU = pOutfile->addTable("CATALOGUE", nTotal, ColumnNames, ColumnFormats, ColumnUnits);
+        vector<int> Reserved(nReserve, ad::skipboth);
+        NewCatalogueHDU->column("SKIPDET").write(Reserved, nTotal + 1);
+    }
     
 //    /* Create a new hdu for the false parameters 
 //     
@@ -249,8 +487,12 @@ void CopyFileEfficiently(const string &Filename, const int nExtra, const string
 
     vector<long> naxes(2);
     naxes[0] = nFrames;
-    naxes[1] = nTotal;
+    naxes[1] = nTotal + nReserve;
+
 
+    /*  every image is created first, then the values which cannot be
+     *  copied raw stream through the pipeline from one image to the next */
+    ImageCopyPipeline Pipeline(pInfile->fitsPointer(), pOutfile->fitsPointer(), AllowedSystemMemory);
 
     for (StringVector::const_iterator i=ImageHDUNames.begin();
             i!=ImageHDUNames.end();
@@ -263,97 +505,36 @@ void CopyFileEfficiently(const string &Filename, const int nExtra, const string
 
 
         /*  add the hdu */
-        ExtHDU *NewHDU = pOutfile->addImage(*i, bitpix, naxes);
+        pOutfile->addImage(*i, bitpix, naxes);
         ExtHDU &OldHDU = pInfile->extension(*i);
-        fitsfile *infptr = pInfile->fitsPointer();
-        fitsfile *outfptr = pOutfile->fitsPointer();
 
-        /*  copy the data across one line at a time */
-        switch (bitpix)
+        OldHDU.makeThisCurrent();
+        if (RawPossible && StoredUnscaled(pInfile->fitsPointer()))
         {
-            case BYTE_IMG:
-                CopyImageData<unsigned int>(OldHDU, *NewHDU, infptr, outfptr, AllowedSystemMemory);
-                break;
-            case SHORT_IMG:
-                CopyImageData<int>(OldHDU, *NewHDU, infptr, outfptr, AllowedSystemMemory);
-                break;
-            case LONG_IMG:
-                CopyImageData<long>(OldHDU, *NewHDU, infptr, outfptr, AllowedSystemMemory);
-                break;
-            case LONGLONG_IMG:
-                CopyImageData<long long>(OldHDU, *NewHDU, infptr, outfptr, AllowedSystemMemory);
-                break;
-            case FLOAT_IMG:
-                CopyImageData<float>(OldHDU, *NewHDU, infptr, outfptr, AllowedSystemMemory);
-                break;
-            case DOUBLE_IMG:
-                CopyImageData<double>(OldHDU, *NewHDU, infptr, outfptr, AllowedSystemMemory);
-                break;
-            default:
-                cerr << "Unknown HDU type encountered: " << bitpix << endl;
+            /*  copied once both files are closed, the new rows are left as zeros */
+            RawImage image;
+            image.name = *i;
+            image.bitpix = bitpix;
+            RawImages.push_back(image);
+            continue;
         }
 
+        Pipeline.Add(*i, bitpix, OldHDU.axis(0) * nObjects);
     }
 
+    Pipeline.Run();
 
-
-
-}
-
-template <typename T>
-void CopyImageData(ExtHDU &InHDU, ExtHDU &OutHDU, fitsfile *infptr, fitsfile *outfptr, float MemLimit)
-{
-    /*  just copy the existing data across */
-    const long nFrames = InHDU.axis(0);
-    const long nObjects = InHDU.axis(1);
-    const long N = nObjects * nFrames;
-    int status = 0;
-
-    const long nElementsInMemory = long(MemLimit / sizeof(T));
-    cout << "Elements are " << sizeof(T) << " bytes" << endl;
-    const long nIterationsRequired = (N / nElementsInMemory) + 1;
-    cout << "Can load " << nElementsInMemory << " elements into memory" << endl;
-    cout << "Going to take " << nIterationsRequired << " iterations" << endl;
-
-    FITSUtil::MatchType<T> DataType;
-    //cout << "Fitsio data type: " << DataType() << endl;
-
-
-
-    //valarray<T> buffer(nElementsInMemory);
-    vector<T> buffer(nElementsInMemory);
-    for (int iter=0; iter<nIterationsRequired; ++iter)
+    if (!RawImages.empty())
     {
-        long FirstElement = 1 + iter * nElementsInMemory;
-
-        if (iter != nIterationsRequired - 1)
-        {
-            cout << "Iteration " << iter + 1 << ", reading from element " << FirstElement << " to " << FirstElement + nElementsInMemory << endl;
+        /*  closing the files makes cfitsio write out every header and
+         *  size every data unit */
+        pOutfile.reset();
+        pInfile.reset();
 
-            //InHDU.read(buffer, FirstElement, nElementsInMemory);
-            fits_read_img(infptr, DataType(), FirstElement, nElementsInMemory, 0, &buffer[0], 0, &status);
-            if (status) { throw FitsioException(status); }
-
-            fits_write_img(outfptr, DataType(), FirstElement, nElementsInMemory, &buffer[0], &status);
-            if (status) { throw FitsioException(status); }
-        }
-        else
-        {
-            const long nElementsLeft = N - iter * nElementsInMemory;
-
-            /*  resize the buffer */
-            buffer.resize(nElementsLeft);
-
-            cout << "Iteration " << iter + 1 << ", reading from element " << FirstElement << " to " << FirstElement + nElementsLeft << endl;
+        CopyRawImages(InPath, OutPath, RawImages, nObjects * nFrames, AllowedSystemMemory);
+    }
 
-            fits_read_img(infptr, DataType(), FirstElement, nElementsLeft, 0, &buffer[0], 0, &status);
-            if (status) { throw FitsioException(status); }
 
-            //InHDU.read(buffer, FirstElement, nElementsLeft);
-            fits_write_img(outfptr, DataType(), FirstElement, nElementsLeft, &buffer[0], &status);
-            if (status) { throw FitsioException(status); }
-        }
-    }
 
 
 }
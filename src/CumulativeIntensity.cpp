@@ -0,0 +1,62 @@
+#include "CumulativeIntensity.h"
+#include "FuncIntensity.h"
+#include <map>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    typedef map<vector<double>, boost::shared_ptr<const CumulativeIntensity> > TableCache;
+
+    /** Tables already built this run, keyed by the coefficients then the step */
+    TableCache &Cache()
+    {
+        static TableCache cache;
+        return cache;
+    }
+}
+
+CumulativeIntensity::CumulativeIntensity(const vector<double> &coeffs, double dr)
+{
+    /*  choose a whole number of steps so the final node is exactly r = 1 */
+    const size_t nSteps = static_cast<size_t>(ceil(1. / dr));
+    const double step = 1. / nSteps;
+    mInvStep = nSteps;
+
+    /*  trapezium rule on the same integrand as IntegratedI */
+    mTable.resize(nSteps + 1);
+    mTable[0] = 0.;
+    double previous = 0.;
+    for (size_t j=1; j<=nSteps; ++j)
+    {
+        const double r = j * step;
+        const double current = I(r, coeffs) * 2. * r;
+        mTable[j] = mTable[j-1] + 0.5 * step * (previous + current);
+        previous = current;
+    }
+}
+
+boost::shared_ptr<const CumulativeIntensity> CumulativeIntensity::Get(const vector<double> &coeffs, double dr)
+{
+    vector<double> key(coeffs);
+    key.push_back(dr);
+
+    boost::shared_ptr<const CumulativeIntensity> table;
+
+#pragma omp critical(CumulativeIntensityCache)
+    {
+        TableCache::const_iterator found = Cache().find(key);
+        if (found != Cache().end())
+        {
+            table = found->second;
+        }
+        else
+        {
+            table.reset(new CumulativeIntensity(coeffs, dr));
+            Cache()[key] = table;
+        }
+    }
+
+    return table;
+}
@@ -0,0 +1,577 @@
+#include "FileGrowth.h"
+#include "CopyFileEfficiently.h"
+#include "Exceptions.h"
+#include "ObjectSkipDefs.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <unistd.h>
+
+using namespace std;
+
+typedef vector<string> StringVector;
+
+namespace ad = AlterDetrending;
+
+namespace
+{
+    const char JournalMagic[] = "FILEGROWTH 2";
+
+    /** Journals from before files had reserved rows */
+    const char OldJournalMagic[] = "FILEGROWTH 1";
+
+    /** Size of a FITS block, every header and data unit is padded to it */
+    const LONGLONG BlockSize = 2880;
+
+    StringVector ImageHDUNames()
+    {
+        StringVector names;
+        names.push_back("HJD");
+        names.push_back("FLUX");
+        names.push_back("FLUXERR");
+        names.push_back("CCDX");
+        names.push_back("CCDY");
+        names.push_back("QUALITY");
+        names.push_back("SKYBKG");
+        return names;
+    }
+
+    /** Closes the file if something goes wrong */
+    class FitsFile
+    {
+        public:
+            FitsFile(const string &filename) : mFptr(0)
+            {
+                int status = 0;
+                fits_open_file(&mFptr, filename.c_str(), READWRITE, &status);
+                if (status) throw FitsioException(status);
+            }
+
+            ~FitsFile()
+            {
+                if (mFptr)
+                {
+                    int status = 0;
+                    fits_close_file(mFptr, &status);
+                }
+            }
+
+            void Close()
+            {
+                int status = 0;
+                fits_close_file(mFptr, &status);
+                mFptr = 0;
+                if (status) throw FitsioException(status);
+            }
+
+            void Move(int type, const string &name)
+            {
+                int status = 0;
+                fits_movnam_hdu(mFptr, type, const_cast<char*>(name.c_str()), 0, &status);
+                if (status) throw FitsioException(status);
+            }
+
+            /** Column number, 0 if there is no such column */
+            int ColumnNumber(const string &name)
+            {
+                int status = 0, colnum = 0;
+                fits_get_colnum(mFptr, CASEINSEN, const_cast<char*>(name.c_str()), &colnum, &status);
+                if (status == COL_NOT_FOUND)
+                {
+                    fits_clear_errmsg();
+                    return 0;
+                }
+                if (status) throw FitsioException(status);
+                return colnum;
+            }
+
+            long Rows()
+            {
+                int status = 0;
+                long nRows = 0;
+                fits_get_num_rows(mFptr, &nRows, &status);
+                if (status) throw FitsioException(status);
+                return nRows;
+            }
+
+            /** Image dimensions, returns the bitpix */
+            int ImageSize(vector<long> &naxes)
+            {
+                int status = 0, bitpix = 0, naxis = 0;
+                naxes.assign(2, 0);
+                fits_get_img_param(mFptr, 2, &bitpix, &naxis, &naxes[0], &status);
+                if (status) throw FitsioException(status);
+                if (naxis != 2) throw UsageError("Image HDUs must have two axes");
+                return bitpix;
+            }
+
+            void MovePrimary()
+            {
+                int status = 0, hdutype = 0;
+                fits_movabs_hdu(mFptr, 1, &hdutype, &status);
+                if (status) throw FitsioException(status);
+            }
+
+            /** Reads an integer keyword, false if there is no such keyword */
+            bool ReadKey(const string &name, long &value)
+            {
+                int status = 0;
+                fits_read_key(mFptr, TLONG, name.c_str(), &value, NULL, &status);
+                if (status == KEY_NO_EXIST)
+                {
+                    fits_clear_errmsg();
+                    return false;
+                }
+                if (status) throw FitsioException(status);
+                return true;
+            }
+
+            bool HasKey(const string &name)
+            {
+                int status = 0;
+                char card[FLEN_CARD];
+                fits_read_card(mFptr, const_cast<char*>(name.c_str()), card, &status);
+                if (status == KEY_NO_EXIST)
+                {
+                    fits_clear_errmsg();
+                    return false;
+                }
+                if (status) throw FitsioException(status);
+                return true;
+            }
+
+            /** True if the current HDU takes nKeys more keywords and nBytes
+             *  of data (-1 for the data as it is) without moving the HDUs
+             *  after it */
+            bool HasRoom(int nKeys, LONGLONG nBytes)
+            {
+                int status = 0, current = 0, nHDUs = 0, hdutype = 0;
+                fits_get_hdu_num(mFptr, &current);
+                fits_get_num_hdus(mFptr, &nHDUs, &status);
+                if (status) throw FitsioException(status);
+
+                /*  the last HDU moves nothing when it grows */
+                if (current == nHDUs)
+                    return true;
+
+                int nExisting = 0, nMore = 0;
+                fits_get_hdrspace(mFptr, &nExisting, &nMore, &status);
+
+                LONGLONG headstart = 0, datastart = 0, dataend = 0;
+                fits_get_hduaddrll(mFptr, &headstart, &datastart, &dataend, &status);
+
+                LONGLONG nextstart = 0, nextdata = 0, nextend = 0;
+                fits_movabs_hdu(mFptr, current + 1, &hdutype, &status);
+                fits_get_hduaddrll(mFptr, &nextstart, &nextdata, &nextend, &status);
+                fits_movabs_hdu(mFptr, current, &hdutype, &status);
+                if (status) throw FitsioException(status);
+
+                if (nBytes < 0)
+                    nBytes = dataend - datastart;
+
+                const LONGLONG padded = ((nBytes + BlockSize - 1) / BlockSize) * BlockSize;
+                return (nKeys <= nMore) && (datastart + padded <= nextstart);
+            }
+
+            fitsfile *operator*() const { return mFptr; }
+
+        private:
+            fitsfile *mFptr;
+    };
+
+    /** Bytes a table field of the given format takes in each row */
+    long FieldBytes(const string &format)
+    {
+        int status = 0, typecode = 0;
+        long repeat = 0, width = 0;
+        fits_binary_tform(const_cast<char*>(format.c_str()), &typecode, &repeat, &width, &status);
+        if (status) throw FitsioException(status);
+        return repeat * width;
+    }
+
+    /** Writes and flushes a line of the journal */
+    void AppendLine(const string &journal, const string &line)
+    {
+        FILE *file = fopen(journal.c_str(), "a");
+        if (!file)
+            throw FileNotOpen("Cannot write journal " + journal);
+
+        const bool ok = (fputs((line + "\n").c_str(), file) >= 0) && !fflush(file) && !fsync(fileno(file));
+        if ((fclose(file) != 0) || !ok)
+            throw FileCopyError("Cannot write journal " + journal);
+    }
+}
+
+FileGrowth::FileGrowth(const string &filename)
+: mFilename(filename), mStarted(false)
+{
+    if (Rollback(filename))
+    {
+        cout << "Rolled back an interrupted append to " << filename << endl;
+    }
+}
+
+string FileGrowth::JournalName(const string &filename)
+{
+    return filename + ".journal";
+}
+
+long FileGrowth::Grow(long nExtra)
+{
+    FitsFile file(mFilename);
+
+    /*  a copy made with --reserve records how many of its rows are in use */
+    file.Move(BINARY_TBL, "CATALOGUE");
+    const long nRows = file.Rows();
+    long nObjects = nRows;
+    const bool Reserved = file.ReadKey("ROWSUSED", nObjects);
+    if ((nObjects < 0) || (nObjects > nRows))
+        throw UsageError("ROWSUSED of " + mFilename + " does not match its catalogue");
+
+    /*  the reserved rows are filled first, the file only grows past them */
+    const long nNeeded = max(nRows, nObjects + nExtra);
+
+    StringVector names, formats, units;
+    SyntheticColumns(names, formats, units);
+
+    StringVector Missing;
+    long RowBytes = 0, HeapBytes = 0;
+    int nKeys = 0;
+    file.ReadKey("NAXIS1", RowBytes);
+    file.ReadKey("PCOUNT", HeapBytes);
+    for (size_t i=0; i<names.size(); ++i)
+    {
+        if (!file.ColumnNumber(names[i]))
+        {
+            Missing.push_back(names[i]);
+            RowBytes += FieldBytes(formats[i]);
+            nKeys += units[i].empty() ? 2 : 3;
+        }
+    }
+
+    /*  cfitsio moves every later HDU when one outgrows the padding at its
+     *  end, which rewrites most of the file, so that is refused */
+    StringVector Shifted;
+    if ((nNeeded > nRows) || !Missing.empty())
+    {
+        if (!file.HasRoom(nKeys, LONGLONG(RowBytes) * nNeeded + HeapBytes))
+            Shifted.push_back("CATALOGUE");
+    }
+
+    const StringVector Images = ImageHDUNames();
+    for (size_t i=0; i<Images.size(); ++i)
+    {
+        vector<long> naxes;
+        file.Move(IMAGE_HDU, Images[i]);
+        const int bitpix = file.ImageSize(naxes);
+        if (naxes[1] != nRows)
+            throw UsageError("Image " + Images[i] + " does not have a row for every catalogue entry");
+
+        if ((nNeeded > nRows) && !file.HasRoom(0, LONGLONG(labs(bitpix) / 8) * naxes[0] * nNeeded))
+            Shifted.push_back(Images[i]);
+    }
+
+    /*  the keywords the run adds to the primary header */
+    const char *PrimaryKeys[] = { "TRANSINJ", "NOISSEED", "NSYNTH" };
+    int nPrimaryKeys = 0;
+    file.MovePrimary();
+    for (size_t i=0; i<sizeof(PrimaryKeys) / sizeof(PrimaryKeys[0]); ++i)
+    {
+        if (!file.HasKey(PrimaryKeys[i]))
+            ++nPrimaryKeys;
+    }
+    if (!file.HasRoom(nPrimaryKeys, -1))
+        Shifted.push_back("primary");
+
+    if (!Shifted.empty())
+    {
+        stringstream ss;
+        ss << "Adding " << nExtra << " objects to " << mFilename << " would move the HDUs after the";
+        for (size_t i=0; i<Shifted.size(); ++i)
+        {
+            ss << (i ? ", " : " ") << Shifted[i];
+        }
+        ss << (Shifted.size() > 1 ? " HDUs" : " HDU") << ", copy the input with --reserve to leave room for appends";
+        throw UsageError(ss.str());
+    }
+
+    long nSynthetics = -1, seed = 0;
+    const bool Counted = file.ReadKey("NSYNTH", nSynthetics);
+    const bool Seeded = file.ReadKey("NOISSEED", seed);
+
+    /*  the journal is complete before anything changes, written to a
+     *  temporary file first so a partial journal is never seen */
+    stringstream ss;
+    ss << JournalMagic << "\n" << "CATALOGUE " << nObjects << "\n" << "ROWS " << nRows << "\n";
+    if (Reserved)
+    {
+        ss << "ROWSUSED\n";
+    }
+    if (Counted)
+    {
+        ss << "NSYNTH " << nSynthetics << "\n";
+    }
+    if (Seeded)
+    {
+        ss << "NOISSEED " << seed << "\n";
+    }
+    for (size_t i=0; i<Missing.size(); ++i)
+    {
+        ss << "COLUMN " << Missing[i] << "\n";
+    }
+
+    const string journal = JournalName(mFilename);
+    const string tmpname = journal + ".tmp";
+    remove(tmpname.c_str());
+    AppendLine(tmpname, ss.str() + "BEGIN");
+    if (rename(tmpname.c_str(), journal.c_str()))
+    {
+        remove(tmpname.c_str());
+        throw FileCopyError("Cannot write journal " + journal);
+    }
+    mStarted = true;
+
+    /*  the catalogue gains the synthetic columns it lacks, then the rows */
+    int status = 0;
+    file.Move(BINARY_TBL, "CATALOGUE");
+    for (size_t i=0; i<names.size(); ++i)
+    {
+        if (file.ColumnNumber(names[i]))
+            continue;
+
+        int nColumns = 0;
+        fits_get_num_cols(*file, &nColumns, &status);
+        fits_insert_col(*file, nColumns + 1, const_cast<char*>(names[i].c_str()), const_cast<char*>(formats[i].c_str()), &status);
+        if (!units[i].empty())
+        {
+            char keyname[FLEN_KEYWORD];
+            fits_make_keyn("TUNIT", nColumns + 1, keyname, &status);
+            fits_update_key_str(*file, keyname, units[i].c_str(), "", &status);
+        }
+        if (status) throw FitsioException(status);
+    }
+
+    if (nNeeded > nRows)
+    {
+        fits_insert_rows(*file, nRows, nNeeded - nRows, &status);
+        if (status) throw FitsioException(status);
+    }
+
+    if (Reserved)
+    {
+        long nUsed = nObjects + nExtra;
+        fits_update_key(*file, TLONG, "ROWSUSED", &nUsed, "Catalogue rows holding objects", &status);
+        if (status) throw FitsioException(status);
+    }
+
+    /*  the objects are the second axis so new rows go on the end */
+    for (size_t i=0; (nNeeded > nRows) && (i<Images.size()); ++i)
+    {
+        vector<long> naxes;
+        file.Move(IMAGE_HDU, Images[i]);
+        const int bitpix = file.ImageSize(naxes);
+
+        cout << "Growing the " << Images[i] << " HDU" << endl;
+        naxes[1] = nNeeded;
+        fits_resize_img(*file, bitpix, 2, &naxes[0], &status);
+        if (status) throw FitsioException(status);
+    }
+
+    int TransInj = 1;
+    file.MovePrimary();
+    fits_update_key(*file, TLOGICAL, "TRANSINJ", &TransInj, "Contains false transits", &status);
+    if (status) throw FitsioException(status);
+
+    file.Close();
+
+    cout << nExtra << " objects appended to the " << nObjects << " in " << mFilename;
+    if (nRows > nObjects)
+    {
+        cout << ", " << min(nExtra, nRows - nObjects) << " of them in reserved rows";
+    }
+    cout << endl;
+    return nObjects;
+}
+
+void FileGrowth::RecordSkipdet(long row, int value)
+{
+    if (!mStarted)
+        return;
+
+    stringstream ss;
+    ss << "SKIPDET " << row << " " << value;
+    AppendLine(JournalName(mFilename), ss.str());
+}
+
+void FileGrowth::Commit()
+{
+    if (!mStarted)
+        return;
+
+    if (remove(JournalName(mFilename).c_str()))
+        throw FileCopyError("Cannot remove journal " + JournalName(mFilename));
+
+    mStarted = false;
+}
+
+bool FileGrowth::Rollback(const string &filename)
+{
+    const string journal = JournalName(filename);
+    ifstream infile(journal.c_str());
+    if (!infile.is_open())
+        return false;
+
+    string line;
+    if (!getline(infile, line) || ((line != JournalMagic) && (line != OldJournalMagic)))
+        throw FileCopyError("Journal " + journal + " is not readable, remove it by hand");
+
+    /*  older journals did not record the primary header keys */
+    const bool RecordsKeys = (line == JournalMagic);
+
+    long nObjects = -1, nRows = -1, nSynthetics = -1, seed = 0;
+    bool Reserved = false, Seeded = false;
+    StringVector Added;
+    vector<pair<long, int> > Skipdet;
+    while (getline(infile, line))
+    {
+        stringstream ss(line);
+        string kind;
+        ss >> kind;
+        if (kind == "CATALOGUE")
+        {
+            ss >> nObjects;
+        }
+        else if (kind == "ROWS")
+        {
+            ss >> nRows;
+        }
+        else if (kind == "ROWSUSED")
+        {
+            Reserved = true;
+        }
+        else if (kind == "NSYNTH")
+        {
+            ss >> nSynthetics;
+        }
+        else if (kind == "NOISSEED")
+        {
+            if (ss >> seed)
+                Seeded = true;
+        }
+        else if (kind == "COLUMN")
+        {
+            string name;
+            ss >> name;
+            Added.push_back(name);
+        }
+        else if (kind == "SKIPDET")
+        {
+            /*  the last line may have been cut short */
+            long row;
+            int value;
+            if (ss >> row >> value)
+                Skipdet.push_back(make_pair(row, value));
+        }
+    }
+
+    if (nObjects < 0)
+        throw FileCopyError("Journal " + journal + " is not readable, remove it by hand");
+
+    /*  older journals come from files without reserved rows */
+    if (nRows < nObjects)
+        nRows = nObjects;
+
+    FitsFile file(filename);
+    int status = 0;
+
+    file.Move(BINARY_TBL, "CATALOGUE");
+
+    /*  the earliest value of each cell is the original */
+    const int SkipdetColumn = file.ColumnNumber("SKIPDET");
+    for (size_t i=Skipdet.size(); i-->0; )
+    {
+        if (SkipdetColumn && (Skipdet[i].first < nObjects))
+        {
+            fits_write_col(*file, TINT, SkipdetColumn, Skipdet[i].first + 1, 1, 1, &Skipdet[i].second, &status);
+            if (status) throw FitsioException(status);
+        }
+    }
+
+    /*  reserved rows the run filled are empty again */
+    const long nCurrentRows = file.Rows();
+    const long nRefilled = min(nRows, nCurrentRows) - nObjects;
+    if (Reserved && SkipdetColumn && (nRefilled > 0))
+    {
+        vector<int> Flags(nRefilled, ad::skipboth);
+        fits_write_col(*file, TINT, SkipdetColumn, nObjects + 1, 1, nRefilled, &Flags[0], &status);
+        fits_update_key(*file, TLONG, "ROWSUSED", &nObjects, "Catalogue rows holding objects", &status);
+        if (status) throw FitsioException(status);
+    }
+
+    if (nCurrentRows > nRows)
+    {
+        fits_delete_rows(*file, nRows + 1, nCurrentRows - nRows, &status);
+        if (status) throw FitsioException(status);
+    }
+
+    for (size_t i=0; i<Added.size(); ++i)
+    {
+        const int colnum = file.ColumnNumber(Added[i]);
+        if (colnum)
+        {
+            fits_delete_col(*file, colnum, &status);
+            if (status) throw FitsioException(status);
+        }
+    }
+
+    const StringVector Images = ImageHDUNames();
+    for (size_t i=0; i<Images.size(); ++i)
+    {
+        vector<long> naxes;
+        file.Move(IMAGE_HDU, Images[i]);
+        const int bitpix = file.ImageSize(naxes);
+        if (naxes[1] == nRows)
+            continue;
+
+        naxes[1] = nRows;
+        fits_resize_img(*file, bitpix, 2, &naxes[0], &status);
+        if (status) throw FitsioException(status);
+    }
+
+    /*  the next run numbers its noise streams from the restored count,
+     *  with the seed the earlier synthetics were made with */
+    if (RecordsKeys)
+    {
+        file.MovePrimary();
+        if (nSynthetics >= 0)
+        {
+            fits_update_key(*file, TLONG, "NSYNTH", &nSynthetics, "Synthetics injected so far", &status);
+        }
+        else if (file.HasKey("NSYNTH"))
+        {
+            fits_delete_key(*file, "NSYNTH", &status);
+        }
+
+        if (Seeded)
+        {
+            fits_update_key(*file, TLONG, "NOISSEED", &seed, "Seed for the synthetic noise", &status);
+        }
+        else if (file.HasKey("NOISSEED"))
+        {
+            fits_delete_key(*file, "NOISSEED", &status);
+        }
+        if (status) throw FitsioException(status);
+    }
+
+    file.Close();
+
+    if (remove(journal.c_str()))
+        throw FileCopyError("Cannot remove journal " + journal);
+
+    return true;
+}
@@ -0,0 +1,122 @@
+#include "FluxModel.h"
+#include "CumulativeIntensity.h"
+#include "FluxTable.h"
+#include "FuncSquare.h"
+#include "FuncIntensity.h"
+#include "FuncOmega.h"
+#include "Exceptions.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+int FluxEngine::FromString(const string &name)
+{
+    string upper = name;
+    transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+
+    if ((upper == "") || (upper == "RIEMANN"))
+        return riemann;
+
+    if (upper == "ANALYTIC")
+        return analytic;
+
+    if (upper == "CUMULATIVE")
+        return cumulative;
+
+    if (upper == "TABLE")
+        return table;
+
+    throw XMLException("Unknown flux engine: " + name);
+}
+
+string FluxEngine::ToString(int engine)
+{
+    switch (engine)
+    {
+        case analytic:
+            return "analytic";
+        case cumulative:
+            return "cumulative";
+        case table:
+            return "table";
+        default:
+            return "riemann";
+    }
+}
+
+FluxModel::FluxModel(const vector<double> &coeffs, double dr, int engine, double tolerance, const string &directory)
+: mCoeffs(coeffs), mOmega(calcOmega(coeffs)), mDR(dr), mEngine(engine)
+{
+    if (mEngine == FluxEngine::cumulative)
+    {
+        mTable = CumulativeIntensity::Get(coeffs, dr);
+    }
+    else if (mEngine == FluxEngine::table)
+    {
+        mFluxTable = FluxTable::Get(coeffs, tolerance, directory);
+    }
+}
+
+double FluxModel::Integral(double rlow, double rhigh) const
+{
+    /*  radius ratios outside the flux table are evaluated analytically */
+    if ((mEngine == FluxEngine::analytic) || (mEngine == FluxEngine::table))
+    {
+        return IntegratedIAnalytic(mCoeffs, rlow, rhigh);
+    }
+
+    if (mEngine == FluxEngine::cumulative)
+    {
+        return mTable->Integral(rlow, rhigh);
+    }
+
+    return IntegratedIKernel(mDR, mCoeffs, rlow, rhigh);
+}
+
+double FluxModel::Flux(double z, double p) const
+{
+    if (z > 1 + p)
+    {
+        return 1.;
+    }
+
+    if (mFluxTable && FluxTable::Contains(p))
+    {
+        return mFluxTable->Flux(z, p);
+    }
+
+    if (z <= 1 - p)
+    {
+        /* I*(z) tends to I(p) as z -> 0 and the normalisation diverges */
+        double integral = 0;
+        if ((mEngine != FluxEngine::riemann) && (z < 1E-8))
+        {
+            integral = I(p, mCoeffs);
+        }
+        else
+        {
+            double norm = 1. / (4. * z * p);
+            integral = Integral(z-p, z+p) * norm;
+        }
+
+        return 1. - (square(p) * integral / 4. / mOmega);
+    }
+
+    double startPoint = z - p;
+    double a = square(startPoint);
+    double norm = 1./(1 - a);
+
+    /* Integrate the I*(z) function from startPoint to 1 */
+    double integral = Integral(startPoint, 1.);
+    integral *= norm;
+
+    double insideSqrt = square(p) - square(z - 1.);
+    double sqrtVal = sqrt(insideSqrt);
+    sqrtVal *= (z - 1.);
+
+    double insideAcos = (z - 1.) / p;
+    double firstTerm = square(p) * acos(insideAcos);
+
+    return 1. - (integral * (firstTerm - sqrtVal) / (4. * M_PI * mOmega));
+}
@@ -0,0 +1,250 @@
+#include "FluxTable.h"
+#include "FluxModel.h"
+#include "Hash.h"
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <boost/cstdint.hpp>
+#include <unistd.h>
+
+using namespace std;
+
+const double FluxTable::MaxP = 0.5;
+
+namespace
+{
+    typedef map<vector<double>, boost::shared_ptr<const FluxTable> > TableCache;
+
+    TableCache &Cache()
+    {
+        static TableCache cache;
+        return cache;
+    }
+
+    /** Largest number of nodes in each grid */
+    const size_t MaxNodes = 1 << 22;
+
+    const char Magic[8] = { 'F', 'L', 'U', 'X', 'T', 'B', 'L', '1' };
+
+    /** FNV-1a hash of the table parameters, used for the file name */
+    string TableFilename(const string &directory, const vector<double> &coeffs, double tolerance)
+    {
+        vector<double> key(coeffs);
+        key.push_back(tolerance);
+        key.push_back(FluxTable::MaxP);
+
+        const boost::uint64_t hash = Fnv1a(&key[0], key.size() * sizeof(double));
+
+        char name[64];
+        sprintf(name, "fluxtable_%016llx.bin", static_cast<unsigned long long>(hash));
+
+        return directory.empty() ? string(name) : directory + "/" + name;
+    }
+
+    /** Exact flux used to fill and check the grids */
+    double ExactFlux(const FluxModel &model, double z, double p)
+    {
+        return p > 0. ? model.Flux(z, p) : 1.;
+    }
+}
+
+FluxTable::FluxTable(const vector<double> &coeffs, double tolerance)
+{
+    size_t ns = 65, np = 17;
+    for (;;)
+    {
+        Fill(coeffs, ns, np);
+
+        const bool sConverged = MaxError(coeffs, true) <= tolerance;
+        const bool pConverged = MaxError(coeffs, false) <= tolerance;
+        if (sConverged && pConverged)
+            break;
+
+        const size_t newNS = sConverged ? ns : 2 * ns - 1;
+        const size_t newNP = pConverged ? np : 2 * np - 1;
+        if (newNS * newNP > MaxNodes)
+        {
+            cerr << "Flux table tolerance " << tolerance << " not reached with " << ns << "x" << np << " nodes" << endl;
+            break;
+        }
+
+        ns = newNS;
+        np = newNP;
+    }
+
+    cout << "Flux table built with " << mNS << "x" << mNP << " nodes" << endl;
+}
+
+void FluxTable::Fill(const vector<double> &coeffs, size_t ns, size_t np)
+{
+    const FluxModel model(coeffs, 0., FluxEngine::analytic);
+
+    mNS = ns;
+    mNP = np;
+    mInvPStep = (np - 1) / MaxP;
+    mInner.resize(ns * np);
+    mIngress.resize(ns * np);
+
+#pragma omp parallel for
+    for (long j=0; j<(long)np; ++j)
+    {
+        const double p = j / mInvPStep;
+        for (size_t i=0; i<ns; ++i)
+        {
+            const double s = double(i) / (ns - 1);
+            mInner[j * ns + i] = ExactFlux(model, s * (1. - p), p);
+            mIngress[j * ns + i] = ExactFlux(model, 1. - p + 2. * p * s, p);
+        }
+    }
+}
+
+double FluxTable::MaxError(const vector<double> &coeffs, bool alongS) const
+{
+    const FluxModel model(coeffs, 0., FluxEngine::analytic);
+
+    /*  only a subset of the rows (or columns) is checked */
+    const size_t nLines = alongS ? mNP : mNS;
+    const size_t stride = nLines > 64 ? nLines / 64 : 1;
+    const size_t nCells = alongS ? mNS - 1 : mNP - 1;
+
+    double maxError = 0;
+    for (size_t line=stride; line<nLines; line+=stride)
+    {
+        for (size_t cell=0; cell<nCells; ++cell)
+        {
+            double s, p;
+            if (alongS)
+            {
+                s = (cell + 0.5) / (mNS - 1);
+                p = line / mInvPStep;
+            }
+            else
+            {
+                s = double(line) / (mNS - 1);
+                p = (cell + 0.5) / mInvPStep;
+            }
+
+            const double inner = fabs(Interpolate(mInner, s, p) - ExactFlux(model, s * (1. - p), p));
+            const double ingress = fabs(Interpolate(mIngress, s, p) - ExactFlux(model, 1. - p + 2. * p * s, p));
+            maxError = max(maxError, max(inner, ingress));
+        }
+    }
+
+    return maxError;
+}
+
+bool FluxTable::Load(const string &filename, const vector<double> &coeffs, double tolerance)
+{
+    ifstream infile(filename.c_str(), ios::binary);
+    if (!infile.is_open())
+        return false;
+
+    char magic[8];
+    double header[7];
+    boost::uint64_t dims[2];
+    infile.read(magic, sizeof(magic));
+    infile.read(reinterpret_cast<char*>(header), sizeof(header));
+    infile.read(reinterpret_cast<char*>(dims), sizeof(dims));
+    if (!infile || memcmp(magic, Magic, sizeof(Magic)))
+        return false;
+
+    /*  make sure the file describes the requested table */
+    for (size_t i=0; i<5; ++i)
+    {
+        if (header[i] != coeffs[i])
+            return false;
+    }
+
+    if ((header[5] != tolerance) || (header[6] != MaxP) || (dims[0] < 2) || (dims[1] < 2) || (dims[0] * dims[1] > MaxNodes))
+        return false;
+
+    mNS = dims[0];
+    mNP = dims[1];
+    mInvPStep = (mNP - 1) / MaxP;
+    mInner.resize(mNS * mNP);
+    mIngress.resize(mNS * mNP);
+    infile.read(reinterpret_cast<char*>(&mInner[0]), mInner.size() * sizeof(double));
+    infile.read(reinterpret_cast<char*>(&mIngress[0]), mIngress.size() * sizeof(double));
+
+    return infile.good();
+}
+
+void FluxTable::Save(const string &filename, const vector<double> &coeffs, double tolerance) const
+{
+    /*  write to a temporary file first so other jobs never see a partial table */
+    stringstream ss;
+    ss << filename << "." << getpid() << ".tmp";
+    const string tmpname = ss.str();
+
+    ofstream outfile(tmpname.c_str(), ios::binary);
+    if (!outfile.is_open())
+    {
+        cerr << "Cannot write flux table " << filename << endl;
+        return;
+    }
+
+    double header[7];
+    for (size_t i=0; i<5; ++i)
+    {
+        header[i] = coeffs[i];
+    }
+    header[5] = tolerance;
+    header[6] = MaxP;
+    const boost::uint64_t dims[2] = { mNS, mNP };
+
+    outfile.write(Magic, sizeof(Magic));
+    outfile.write(reinterpret_cast<const char*>(header), sizeof(header));
+    outfile.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    outfile.write(reinterpret_cast<const char*>(&mInner[0]), mInner.size() * sizeof(double));
+    outfile.write(reinterpret_cast<const char*>(&mIngress[0]), mIngress.size() * sizeof(double));
+    outfile.close();
+
+    if (!outfile || rename(tmpname.c_str(), filename.c_str()))
+    {
+        cerr << "Cannot write flux table " << filename << endl;
+        remove(tmpname.c_str());
+    }
+}
+
+boost::shared_ptr<const FluxTable> FluxTable::Get(const vector<double> &coeffs, double tolerance, const string &directory)
+{
+    vector<double> key(coeffs);
+    key.push_back(tolerance);
+
+    boost::shared_ptr<const FluxTable> table;
+
+#pragma omp critical(FluxTableCache)
+    {
+        TableCache::const_iterator found = Cache().find(key);
+        if (found != Cache().end())
+        {
+            table = found->second;
+        }
+        else
+        {
+            const string filename = TableFilename(directory, coeffs, tolerance);
+
+            FluxTable *loaded = new FluxTable;
+            if (loaded->Load(filename, coeffs, tolerance))
+            {
+                cout << "Flux table loaded from " << filename << endl;
+                table.reset(loaded);
+            }
+            else
+            {
+                delete loaded;
+                FluxTable *built = new FluxTable(coeffs, tolerance);
+                table.reset(built);
+                built->Save(filename, coeffs, tolerance);
+            }
+
+            Cache()[key] = table;
+        }
+    }
+
+    return table;
+}
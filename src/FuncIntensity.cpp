@@ -54,3 +54,39 @@ double IntegratedI(double dr, const std::vector<double> &coeffs, double rlow, do
 	return sum;
 
 }
+
+
+/** Closed form of IntegratedI
+ *
+ * With u = 1 - r^2 the intensity is a polynomial in u^(1/4),
+ * I(u) = c0 + sum_n c_n u^(n/4), so the antiderivative of I(r) * 2r
+ * is -H(u) with H(u) = sum_n 4 c_n u^((n+4)/4) / (n+4). u is clamped
+ * to [0, 1] to match the stellar disc. */
+double IntegratedIAnalytic(const std::vector<double> &coeffs, double rlow, double rhigh)
+{
+	double c0 = 1.;
+	for (int i=1; i<=4; ++i)
+	{
+		c0 -= coeffs[i];
+	}
+
+	double H[2];
+	const double r[2] = { rlow, rhigh };
+	for (int j=0; j<2; ++j)
+	{
+		double u = 1. - square(r[j]);
+		u = u < 0. ? 0. : (u > 1. ? 1. : u);
+
+		/* powers of u^(1/4) from square roots rather than pow */
+		const double q = sqrt(sqrt(u));
+		double qn = q;
+
+		H[j] = c0 * u;
+		for (int i=1; i<=4; ++i, qn *= q)
+		{
+			H[j] += 4. * coeffs[i] * u * qn / (i + 4.);
+		}
+	}
+
+	return H[0] - H[1];
+}
@@ -0,0 +1,177 @@
+#include "FuncIntensity.h"
+#include "FuncSquare.h"
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INTENSITY_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*  Vectorised versions of IntegratedI
+ *
+ *  Each kernel returns sum_k I(r_k) * r_k for r_k = rlow + k * dr, k < n,
+ *  with the powers of (1 - r^2)^(1/4) built from square roots. The
+ *  coefficients are passed as c0' = 1 - c1 - c2 - c3 - c4 followed by c1-c4
+ *  so that I = c0' + c1 q + c2 q^2 + c3 q^3 + c4 q^4 with q = (1 - r^2)^(1/4). */
+
+namespace
+{
+    typedef double (*Kernel)(const double *c, double rlow, double dr, long n);
+
+    double ScalarKernel(const double *c, double rlow, double dr, long n)
+    {
+        double sum = 0;
+        for (long k=0; k<n; ++k)
+        {
+            const double r = rlow + k * dr;
+            const double u = 1. - square(r);
+            const double q2 = sqrt(u);
+            const double q1 = sqrt(q2);
+            const double I = c[0] + c[1] * q1 + c[2] * q2 + c[3] * q1 * q2 + c[4] * u;
+            sum += I * r;
+        }
+        return sum;
+    }
+
+#ifdef INTENSITY_X86_KERNELS
+    __attribute__((target("avx2,fma")))
+    double AVX2Kernel(const double *c, double rlow, double dr, long n)
+    {
+        const __m256d c0 = _mm256_set1_pd(c[0]);
+        const __m256d c1 = _mm256_set1_pd(c[1]);
+        const __m256d c2 = _mm256_set1_pd(c[2]);
+        const __m256d c3 = _mm256_set1_pd(c[3]);
+        const __m256d c4 = _mm256_set1_pd(c[4]);
+        const __m256d one = _mm256_set1_pd(1.);
+        const __m256d vdr = _mm256_set1_pd(dr);
+        const __m256d vrlow = _mm256_set1_pd(rlow);
+        __m256d k = _mm256_set_pd(3., 2., 1., 0.);
+        const __m256d step = _mm256_set1_pd(4.);
+
+        __m256d sum = _mm256_setzero_pd();
+        long i = 0;
+        for (; i+4<=n; i+=4)
+        {
+            const __m256d r = _mm256_fmadd_pd(k, vdr, vrlow);
+            const __m256d u = _mm256_fnmadd_pd(r, r, one);
+            const __m256d q2 = _mm256_sqrt_pd(u);
+            const __m256d q1 = _mm256_sqrt_pd(q2);
+
+            __m256d I = _mm256_fmadd_pd(c4, u, c0);
+            I = _mm256_fmadd_pd(c1, q1, I);
+            I = _mm256_fmadd_pd(c2, q2, I);
+            I = _mm256_fmadd_pd(_mm256_mul_pd(c3, q1), q2, I);
+            sum = _mm256_fmadd_pd(I, r, sum);
+
+            k = _mm256_add_pd(k, step);
+        }
+
+        double lanes[4];
+        _mm256_storeu_pd(lanes, sum);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + ScalarKernel(c, rlow + i * dr, dr, n - i);
+    }
+
+    __attribute__((target("avx512f")))
+    double AVX512Kernel(const double *c, double rlow, double dr, long n)
+    {
+        const __m512d c0 = _mm512_set1_pd(c[0]);
+        const __m512d c1 = _mm512_set1_pd(c[1]);
+        const __m512d c2 = _mm512_set1_pd(c[2]);
+        const __m512d c3 = _mm512_set1_pd(c[3]);
+        const __m512d c4 = _mm512_set1_pd(c[4]);
+        const __m512d one = _mm512_set1_pd(1.);
+        const __m512d vdr = _mm512_set1_pd(dr);
+        const __m512d vrlow = _mm512_set1_pd(rlow);
+        __m512d k = _mm512_set_pd(7., 6., 5., 4., 3., 2., 1., 0.);
+        const __m512d step = _mm512_set1_pd(8.);
+
+        __m512d sum = _mm512_setzero_pd();
+        long i = 0;
+        for (; i+8<=n; i+=8)
+        {
+            const __m512d r = _mm512_fmadd_pd(k, vdr, vrlow);
+            const __m512d u = _mm512_fnmadd_pd(r, r, one);
+            const __m512d q2 = _mm512_sqrt_pd(u);
+            const __m512d q1 = _mm512_sqrt_pd(q2);
+
+            __m512d I = _mm512_fmadd_pd(c4, u, c0);
+            I = _mm512_fmadd_pd(c1, q1, I);
+            I = _mm512_fmadd_pd(c2, q2, I);
+            I = _mm512_fmadd_pd(_mm512_mul_pd(c3, q1), q2, I);
+            sum = _mm512_fmadd_pd(I, r, sum);
+
+            k = _mm512_add_pd(k, step);
+        }
+
+        return _mm512_reduce_add_pd(sum) + ScalarKernel(c, rlow + i * dr, dr, n - i);
+    }
+#endif
+
+    struct Dispatch
+    {
+        Kernel kernel;
+        const char *name;
+    };
+
+    /** Picks the widest kernel the cpu supports */
+    Dispatch ChooseKernel()
+    {
+        Dispatch dispatch = { ScalarKernel, "scalar" };
+#ifdef INTENSITY_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            dispatch.kernel = AVX512Kernel;
+            dispatch.name = "avx512";
+        }
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            dispatch.kernel = AVX2Kernel;
+            dispatch.name = "avx2";
+        }
+#endif
+        return dispatch;
+    }
+
+    /** Kernel chosen on first use (static initialisation is thread safe) */
+    const Dispatch &SelectKernel()
+    {
+        static const Dispatch dispatch = ChooseKernel();
+        return dispatch;
+    }
+}
+
+double IntegratedIKernel(double dr, const std::vector<double> &coeffs, double rlow, double rhigh)
+{
+    if (rhigh < rlow)
+        return 0.;
+
+    double c[5];
+    c[0] = 1.;
+    for (int i=1; i<=4; ++i)
+    {
+        c[i] = coeffs[i];
+        c[0] -= coeffs[i];
+    }
+
+    /*  same samples as the IntegratedI loop, r <= rhigh. When rhigh
+     *  lands on a sample the accumulated rounding in that loop decides
+     *  whether it is included, so replay the loop (additions only) */
+    const double nSteps = (rhigh - rlow) / dr;
+    long n = static_cast<long>(floor(nSteps)) + 1;
+    if (fabs(nSteps - floor(nSteps + 0.5)) < 1E-6)
+    {
+        n = 0;
+        for (double r=rlow; r<=rhigh; r+=dr)
+        {
+            ++n;
+        }
+    }
+
+    return SelectKernel().kernel(c, rlow, dr, n) * 2. * dr;
+}
+
+const char *IntensityKernelName()
+{
+    return SelectKernel().name;
+}
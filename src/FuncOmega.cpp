@@ -2,7 +2,7 @@
 
 double calcOmega(const std::vector<double> &coeffs)
 {
-	double returnval;
+	double returnval = 0;
 	for (int n=0; n<=4; ++n)
 	{
 		returnval += coeffs.at(n) / (n + 4.);
@@ -0,0 +1,185 @@
+#include "HostContext.h"
+#include "ModelSampler.h"
+#include "ScratchArena.h"
+#include "CopyParameters.h"
+#include "WaspDateConverter.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    /** Number of samples handled at a time, 16 KB of each host array */
+    const size_t BlockSize = 2048;
+
+    /** Releases the samplers of a batch, even if the batch fails, so none
+     *  holds scratch memory across a reset of the arenas */
+    class SamplerRelease
+    {
+        public:
+            SamplerRelease(boost::ptr_vector<ModelSampler> &samplers) : mSamplers(samplers) {}
+
+            ~SamplerRelease()
+            {
+                for (size_t k=0; k<mSamplers.size(); ++k)
+                {
+                    mSamplers[k].Release();
+                }
+            }
+
+        private:
+            boost::ptr_vector<ModelSampler> &mSamplers;
+    };
+}
+
+HostContext::HostContext(const Lightcurve &host)
+: mHost(host), mTimeBase(host.size(), Lightcurve::TimeColumn), mMean(MeanFlux(host)), mNormalised(host.size())
+{
+    mTimeBase.asWASP = false;
+
+    size_t first = 0;
+    for (size_t i=0; i<host.size(); ++i)
+    {
+        mTimeBase.jd[i] = host.asWASP ? wd2jd(host.jd[i]) : host.jd[i];
+        mNormalised[i] = host.flux[i] / mMean;
+
+        if (isnan(mTimeBase.jd[i]) || isnan(host.flux[i]))
+        {
+            if (i > first)
+                mValidSpans.push_back(IndexRange(first, i));
+            first = i + 1;
+        }
+    }
+
+    if (host.size() > first)
+        mValidSpans.push_back(IndexRange(first, host.size()));
+}
+
+const vector<double> &HostContext::Phase(double period, double epoch)
+{
+    const pair<double, double> key(period, epoch);
+
+    PhaseMap::iterator found = mPhases.find(key);
+    if (found == mPhases.end())
+    {
+        found = mPhases.insert(make_pair(key, mTimeBase.phase(period, epoch))).first;
+    }
+
+    return found->second;
+}
+
+void HostContext::KeepPhases(const vector<Lightcurve> &models)
+{
+    /*  phases shared with the previous batch stay rather than being folded
+        again, so a radius sweep folds its host once. Erasing the others in
+        place allocates nothing */
+    for (PhaseMap::iterator phase=mPhases.begin(); phase!=mPhases.end(); )
+    {
+        bool needed = false;
+        for (size_t k=0; (k<models.size()) && !needed; ++k)
+        {
+            needed = (models[k].period == phase->first.first) && (models[k].epoch == phase->first.second);
+        }
+
+        if (needed)
+            ++phase;
+        else
+            mPhases.erase(phase++);
+    }
+}
+
+Lightcurve HostContext::Inject(const Lightcurve &model)
+{
+    vector<Lightcurve> models(1, model), outputs;
+    Inject(models, outputs);
+    return outputs.front();
+}
+
+void HostContext::Inject(const vector<Lightcurve> &models, vector<Lightcurve> &outputs)
+{
+    const size_t nSamples = mHost.size();
+    const double nan = numeric_limits<double>::quiet_NaN();
+
+    /*  outputs from a previous batch are overwritten, reusing their columns */
+    if (outputs.size() > models.size())
+        outputs.erase(outputs.begin() + models.size(), outputs.end());
+
+    outputs.reserve(models.size());
+    for (size_t k=0; k<outputs.size(); ++k)
+    {
+        outputs[k] = mHost;
+    }
+
+    while (outputs.size() < models.size())
+    {
+        outputs.push_back(mHost);
+    }
+
+    /*  a host sees many batches, only this one's phases are held */
+    KeepPhases(models);
+
+    /*  the samplers are kept between batches, only a larger batch adds any */
+    SamplerRelease release(mSamplers);
+    for (size_t k=0; k<models.size(); ++k)
+    {
+        const Lightcurve &model = models[k];
+        const vector<double> &phase = Phase(model.period, model.epoch);
+        if (k < mSamplers.size())
+        {
+            mSamplers[k].Reset(mTimeBase, model, model.period, model.epoch, &phase);
+        }
+        else
+        {
+            mSamplers.push_back(new ModelSampler(mTimeBase, model, model.period, model.epoch, &phase));
+        }
+
+        CopyParameters(model, outputs[k]);
+    }
+
+    ScratchVector modelFlux(BlockSize);
+    vector<IndexRange>::const_iterator span = mValidSpans.begin();
+    for (size_t first=0; first<nSamples; first+=BlockSize)
+    {
+        const size_t last = min(first + BlockSize, nSamples);
+
+        /*  first span reaching into this block */
+        while ((span != mValidSpans.end()) && (span->second <= first))
+            ++span;
+
+        for (size_t k=0; k<models.size(); ++k)
+        {
+            mSamplers[k].Sample(first, last, &modelFlux[0]);
+            double *flux = &outputs[k].flux[0];
+
+            /*  the valid runs are filled without testing each sample, the
+                gaps between them are null */
+            size_t i = first;
+            for (vector<IndexRange>::const_iterator s=span; (s!=mValidSpans.end()) && (s->first < last); ++s)
+            {
+                const size_t end = min(s->second, last);
+                for (; i<s->first; ++i)
+                {
+                    flux[i] = nan;
+                }
+
+                for (; i<end; ++i)
+                {
+                    /*  same arithmetic as AddTransit, with the normalisation done once */
+                    flux[i] = ((mNormalised[i] + modelFlux[i - first]) - 1.0) * mMean;
+                }
+            }
+
+            for (; i<last; ++i)
+            {
+                flux[i] = nan;
+            }
+        }
+    }
+
+    for (size_t k=0; k<outputs.size(); ++k)
+    {
+        outputs[k].UpdateValidity();
+    }
+}
@@ -0,0 +1,285 @@
+#include "ImageCopyPipeline.h"
+#include "Exceptions.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <sys/time.h>
+
+using namespace std;
+
+namespace
+{
+    /** Number of chunk buffers in the ring */
+    const size_t nChunks = 4;
+
+    /** Smallest chunk worth reading */
+    const size_t MinChunkBytes = 1 << 20;
+
+    double Now()
+    {
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec * 1E-6;
+    }
+}
+
+ImageCopyPipeline::ImageCopyPipeline(fitsfile *infptr, fitsfile *outfptr, double MemoryLimit)
+: mInfptr(infptr), mOutfptr(outfptr), mChunkBytes(max(MinChunkBytes, size_t(MemoryLimit / nChunks))),
+mTotalChunks(0), mChunks(nChunks), mStatus(0)
+{
+}
+
+void ImageCopyPipeline::Add(const string &name, long bitpix, long nElements)
+{
+    /*  the same types the values were always copied as */
+    Image image;
+    switch (bitpix)
+    {
+        case BYTE_IMG:
+            image.datatype = TUINT;
+            image.elementSize = sizeof(unsigned int);
+            break;
+        case SHORT_IMG:
+            image.datatype = TINT;
+            image.elementSize = sizeof(int);
+            break;
+        case LONG_IMG:
+            image.datatype = TLONG;
+            image.elementSize = sizeof(long);
+            break;
+        case LONGLONG_IMG:
+            image.datatype = TLONGLONG;
+            image.elementSize = sizeof(long long);
+            break;
+        case FLOAT_IMG:
+            image.datatype = TFLOAT;
+            image.elementSize = sizeof(float);
+            break;
+        case DOUBLE_IMG:
+            image.datatype = TDOUBLE;
+            image.elementSize = sizeof(double);
+            break;
+        default:
+            cerr << "Unknown HDU type encountered: " << bitpix << endl;
+            return;
+    }
+
+    image.name = name;
+    image.nElements = nElements;
+    image.nBytes = double(nElements) * (labs(bitpix) / 8);
+    image.start = image.end = 0;
+    mImages.push_back(image);
+}
+
+void ImageCopyPipeline::Run()
+{
+    /*  no bigger than the largest image */
+    size_t LargestImage = 0;
+    for (size_t i=0; i<mImages.size(); ++i)
+    {
+        LargestImage = max(LargestImage, size_t(mImages[i].nElements) * mImages[i].elementSize);
+    }
+    mChunkBytes = max(sizeof(double), min(mChunkBytes, LargestImage));
+
+    mTotalChunks = 0;
+    for (size_t i=0; i<mImages.size(); ++i)
+    {
+        const long perChunk = max(long(1), long(mChunkBytes / mImages[i].elementSize));
+        mTotalChunks += (mImages[i].nElements + perChunk - 1) / perChunk;
+    }
+
+    if (mTotalChunks == 0)
+        return;
+
+    for (size_t i=0; i<mChunks.size(); ++i)
+    {
+        mChunks[i].buffer.resize(mChunkBytes);
+    }
+
+    cout << "Copying " << mImages.size() << " images in " << mTotalChunks << " chunks of "
+        << mChunkBytes / 1024. / 1024. << " MB" << endl;
+
+    if (fits_is_reentrant())
+    {
+        mStatus = 0;
+        mFilled.clear();
+        mFree.clear();
+        for (size_t i=0; i<mChunks.size(); ++i)
+        {
+            mFree.push_back(i);
+        }
+
+        boost::thread reader(boost::bind(&ImageCopyPipeline::ReadLoop, this));
+        boost::thread writer(boost::bind(&ImageCopyPipeline::WriteLoop, this));
+        reader.join();
+        writer.join();
+
+        if (mStatus) throw FitsioException(mStatus);
+    }
+    else
+    {
+        cout << "cfitsio is not reentrant, reading and writing in turn" << endl;
+        RunInTurn();
+    }
+
+    Report();
+}
+
+int ImageCopyPipeline::ReadChunk(size_t &image, long &first, Chunk &chunk)
+{
+    /*  empty images have no chunks */
+    while (mImages[image].nElements == 0)
+        ++image;
+
+    Image &current = mImages[image];
+    int status = 0;
+    if (first == 0)
+        fits_movnam_hdu(mInfptr, IMAGE_HDU, const_cast<char*>(current.name.c_str()), 0, &status);
+
+    const long perChunk = max(long(1), long(mChunkBytes / current.elementSize));
+    const long n = min(perChunk, current.nElements - first);
+    fits_read_img(mInfptr, current.datatype, first + 1, n, 0, &chunk.buffer[0], 0, &status);
+
+    chunk.image = image;
+    chunk.first = first;
+    chunk.nElements = n;
+    chunk.last = (first + n == current.nElements);
+
+    /*  carry straight on with the next image */
+    first += n;
+    if (chunk.last)
+    {
+        ++image;
+        first = 0;
+    }
+
+    return status;
+}
+
+int ImageCopyPipeline::WriteChunk(Chunk &chunk)
+{
+    Image &current = mImages[chunk.image];
+    int status = 0;
+    if (chunk.first == 0)
+    {
+        current.start = Now();
+        fits_movnam_hdu(mOutfptr, IMAGE_HDU, const_cast<char*>(current.name.c_str()), 0, &status);
+    }
+
+    fits_write_img(mOutfptr, current.datatype, chunk.first + 1, chunk.nElements, &chunk.buffer[0], &status);
+
+    if (chunk.last)
+        current.end = Now();
+
+    return status;
+}
+
+void ImageCopyPipeline::Fail(int status)
+{
+    {
+        boost::mutex::scoped_lock lock(mMutex);
+        if (!mStatus)
+            mStatus = status;
+    }
+
+    mFilledCondition.notify_all();
+    mFreeCondition.notify_all();
+}
+
+void ImageCopyPipeline::ReadLoop()
+{
+    size_t image = 0;
+    long first = 0;
+    for (size_t c=0; c<mTotalChunks; ++c)
+    {
+        size_t slot;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            while (mFree.empty() && !mStatus)
+                mFreeCondition.wait(lock);
+
+            if (mStatus)
+                return;
+
+            slot = mFree.front();
+            mFree.pop_front();
+        }
+
+        /*  the slot belongs to this thread until it is queued */
+        const int status = ReadChunk(image, first, mChunks[slot]);
+        if (status)
+        {
+            Fail(status);
+            return;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            mFilled.push_back(slot);
+        }
+        mFilledCondition.notify_one();
+    }
+}
+
+void ImageCopyPipeline::WriteLoop()
+{
+    for (size_t c=0; c<mTotalChunks; ++c)
+    {
+        size_t slot;
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            while (mFilled.empty() && !mStatus)
+                mFilledCondition.wait(lock);
+
+            if (mStatus)
+                return;
+
+            slot = mFilled.front();
+            mFilled.pop_front();
+        }
+
+        const int status = WriteChunk(mChunks[slot]);
+        if (status)
+        {
+            Fail(status);
+            return;
+        }
+
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            mFree.push_back(slot);
+        }
+        mFreeCondition.notify_one();
+    }
+}
+
+void ImageCopyPipeline::RunInTurn()
+{
+    size_t image = 0;
+    long first = 0;
+    for (size_t c=0; c<mTotalChunks; ++c)
+    {
+        int status = ReadChunk(image, first, mChunks[0]);
+        if (status) throw FitsioException(status);
+
+        status = WriteChunk(mChunks[0]);
+        if (status) throw FitsioException(status);
+    }
+}
+
+void ImageCopyPipeline::Report() const
+{
+    for (size_t i=0; i<mImages.size(); ++i)
+    {
+        const Image &image = mImages[i];
+        const double MB = image.nBytes / 1024. / 1024.;
+        const double seconds = image.end - image.start;
+
+        cout << image.name << ": " << MB << " MB in " << seconds << " s";
+        if (seconds > 0)
+            cout << ", " << MB / seconds << " MB/s";
+        cout << endl;
+    }
+}
@@ -1,16 +1,94 @@
 #include "Lightcurve.h"
 #include "WaspDateConverter.h"
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 
-Lightcurve::Lightcurve(size_t n)
+namespace
+{
+    /** Phase of n time stamps
+     *
+     * The time base is a template parameter so the wd conversion is chosen
+     * once, not per sample. The loop has no branches (null times fall
+     * through as nans) so it can be vectorised, giving exactly the same
+     * values as before: x - trunc(x) is the fractional part modf returns
+     * and remainder - 0.5 is exact for remainder above a quarter. */
+    template <bool asWASP>
+    void FoldPhase(const double *jd, size_t n, double period, double epoch, double *phase)
+    {
+        const double periodDays = period / secondsInDay;
+
+        for (size_t i=0; i<n; ++i)
+        {
+            const double currentJDValue = asWASP ? wd2jd(jd[i]) : jd[i];
+            const double phaseval = (currentJDValue - epoch) / periodDays;
+            const double remainder = fabs(phaseval - trunc(phaseval));
+
+            /*  remainder - 1 above a half, remainder - 0 otherwise */
+            phase[i] = remainder - ceil(remainder - 0.5);
+        }
+    }
+}
+
+Lightcurve::Lightcurve(size_t n, int columns)
 : npts(n), period(0), epoch(0), radius(0), rstar(0),
-inclination(0), sep(0), obj_id("")
+inclination(0), sep(0), obj_id(""), mPhasePeriod(0), mPhaseEpoch(0), mPhaseWASP(false), mPhaseValid(false),
+mNValid(0), mHasValidity(false)
 {
-    this->jd = vector<double>(n);
-    this->flux = vector<double>(n);
-    this->fluxerr = vector<double>(n);
+    Allocate(columns);
+}
+
+void Lightcurve::Allocate(int columns)
+{
+    if ((columns & TimeColumn) && (jd.size() != npts))
+        jd.resize(npts);
+
+    if ((columns & FluxColumn) && (flux.size() != npts))
+        flux.resize(npts);
+
+    if ((columns & ErrorColumn) && (fluxerr.size() != npts))
+        fluxerr.resize(npts);
+}
+
+bool Lightcurve::allocated(int columns) const
+{
+    return (!(columns & TimeColumn) || (jd.size() == npts))
+        && (!(columns & FluxColumn) || (flux.size() == npts))
+        && (!(columns & ErrorColumn) || (fluxerr.size() == npts));
+}
+
+void Lightcurve::UpdateValidity()
+{
+    const size_t nWords = (flux.size() + 63) / 64;
+    mValid.assign(nWords, 0);
+    mValidSpans.clear();
+    mNValid = 0;
+
+    /*  pack the bits without branching on each value */
+    for (size_t i=0; i<flux.size(); ++i)
+    {
+        const boost::uint64_t bit = (flux[i] == flux[i]);
+        mValid[i >> 6] |= bit << (i & 63);
+        mNValid += bit;
+    }
+
+    /*  then find the runs of set bits */
+    size_t i = 0;
+    while (i < flux.size())
+    {
+        while ((i < flux.size()) && !valid(i))
+            ++i;
+
+        const size_t first = i;
+        while ((i < flux.size()) && valid(i))
+            ++i;
+
+        if (i > first)
+            mValidSpans.push_back(IndexRange(first, i));
+    }
+
+    mHasValidity = true;
 }
 
 size_t Lightcurve::size() const
@@ -24,6 +102,21 @@ void Lightcurve::clear()
     flux.clear();
     fluxerr.clear();
     npts = flux.size();
+    InvalidatePhase();
+
+    mValid.clear();
+    mValidSpans.clear();
+    mNValid = 0;
+    mHasValidity = false;
+}
+
+Lightcurve::Lightcurve(const Lightcurve &obj)
+: npts(obj.npts), obj_id(obj.obj_id), period(obj.period), asWASP(obj.asWASP), radius(obj.radius), rstar(obj.rstar),
+sep(obj.sep), inclination(obj.inclination), epoch(obj.epoch), jd(obj.jd), flux(obj.flux), fluxerr(obj.fluxerr),
+mPhase(obj.mPhase), mPhasePeriod(obj.mPhasePeriod), mPhaseEpoch(obj.mPhaseEpoch), mPhaseWASP(obj.mPhaseWASP),
+mPhaseValid(obj.mPhaseValid), mValid(obj.mValid), mValidSpans(obj.mValidSpans), mNValid(obj.mNValid),
+mHasValidity(obj.mHasValidity)
+{
 }
 
 Lightcurve &Lightcurve::operator=(const Lightcurve &obj)
@@ -46,54 +139,123 @@ Lightcurve &Lightcurve::operator=(const Lightcurve &obj)
 
     
     asWASP = obj.asWASP;
-    
+
+    /*  the cache matches the copied time stamps */
+    mPhase = obj.mPhase;
+    mPhasePeriod = obj.mPhasePeriod;
+    mPhaseEpoch = obj.mPhaseEpoch;
+    mPhaseWASP = obj.mPhaseWASP;
+    mPhaseValid = obj.mPhaseValid;
+
+    mValid = obj.mValid;
+    mValidSpans = obj.mValidSpans;
+    mNValid = obj.mNValid;
+    mHasValidity = obj.mHasValidity;
     
     return *this;
     
 }
 
-vector<double> Lightcurve::phase()
+#if __cplusplus >= 201103L
+Lightcurve::Lightcurve(Lightcurve &&obj)
+: npts(0), period(0), asWASP(false), radius(0), rstar(0), sep(0), inclination(0), epoch(0),
+mPhasePeriod(0), mPhaseEpoch(0), mPhaseWASP(false), mPhaseValid(false), mNValid(0), mHasValidity(false)
 {
-    size_t N = this->size();
-    
-    
-    
-    vector<double> ReturnPhaseVal(N);
-    
-    
-    for (unsigned int i=0; i<N; ++i)
+    swap(obj);
+}
+
+Lightcurve &Lightcurve::operator=(Lightcurve &&obj)
+{
+    /*  same fields as the copying assignment */
+    jd.swap(obj.jd);
+    flux.swap(obj.flux);
+    fluxerr.swap(obj.fluxerr);
+    npts = obj.npts;
+
+    period = obj.period;
+    epoch = obj.epoch;
+    radius = obj.radius;
+    rstar = obj.rstar;
+    inclination = obj.inclination;
+    obj_id.swap(obj.obj_id);
+    asWASP = obj.asWASP;
+
+    mPhase.swap(obj.mPhase);
+    mPhasePeriod = obj.mPhasePeriod;
+    mPhaseEpoch = obj.mPhaseEpoch;
+    mPhaseWASP = obj.mPhaseWASP;
+    mPhaseValid = obj.mPhaseValid;
+
+    mValid.swap(obj.mValid);
+    mValidSpans.swap(obj.mValidSpans);
+    mNValid = obj.mNValid;
+    mHasValidity = obj.mHasValidity;
+
+    obj.clear();
+    return *this;
+}
+#endif
+
+void Lightcurve::swap(Lightcurve &obj)
+{
+    std::swap(npts, obj.npts);
+    obj_id.swap(obj.obj_id);
+    std::swap(period, obj.period);
+    std::swap(asWASP, obj.asWASP);
+    std::swap(radius, obj.radius);
+    std::swap(rstar, obj.rstar);
+    std::swap(sep, obj.sep);
+    std::swap(inclination, obj.inclination);
+    std::swap(epoch, obj.epoch);
+    jd.swap(obj.jd);
+    flux.swap(obj.flux);
+    fluxerr.swap(obj.fluxerr);
+
+    mPhase.swap(obj.mPhase);
+    std::swap(mPhasePeriod, obj.mPhasePeriod);
+    std::swap(mPhaseEpoch, obj.mPhaseEpoch);
+    std::swap(mPhaseWASP, obj.mPhaseWASP);
+    std::swap(mPhaseValid, obj.mPhaseValid);
+
+    mValid.swap(obj.mValid);
+    mValidSpans.swap(obj.mValidSpans);
+    std::swap(mNValid, obj.mNValid);
+    std::swap(mHasValidity, obj.mHasValidity);
+}
+
+const vector<double> &Lightcurve::phase() const
+{
+    return phase(this->period, this->epoch);
+}
+
+const vector<double> &Lightcurve::phase(double period, double epoch) const
+{
+    const size_t N = this->size();
+
+    if (mPhaseValid && (mPhasePeriod == period) && (mPhaseEpoch == epoch)
+        && (mPhaseWASP == asWASP) && (mPhase.size() == N))
     {
-        double currentJDValue = this->jd[i];
-        
-        /*  need to convert from wd if this->asWASP is true */
-        if (asWASP)
-            currentJDValue = wd2jd(currentJDValue);
+        return mPhase;
+    }
 
-        /*  if the jd value is nan then put nan into the array */
-        if (isnan(currentJDValue))
-        {
-            ReturnPhaseVal[i] = currentJDValue;
-        }
+    mPhase.resize(N);
+    if (N > 0)
+    {
+        if (asWASP)
+            FoldPhase<true>(&jd[0], N, period, epoch, &mPhase[0]);
         else
-        {
-            double phaseval = (currentJDValue - this->epoch) / double(this->period / secondsInDay);
-            double nperiods = 0;
-            double remainder = fabs(modf(phaseval, &nperiods));
-            
-            if (remainder > 0.5)
-            {
-                ReturnPhaseVal[i] = remainder - 1.0;
-            }
-            else
-            {
-                ReturnPhaseVal[i] = remainder;
-            }
-        
-        }
+            FoldPhase<false>(&jd[0], N, period, epoch, &mPhase[0]);
     }
-    
-    
-    
-    return ReturnPhaseVal;
-    
+
+    mPhasePeriod = period;
+    mPhaseEpoch = epoch;
+    mPhaseWASP = asWASP;
+    mPhaseValid = true;
+
+    return mPhase;
+}
+
+void Lightcurve::InvalidatePhase()
+{
+    mPhaseValid = false;
 }
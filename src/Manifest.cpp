@@ -0,0 +1,106 @@
+#include "Manifest.h"
+#include "Exceptions.h"
+#include <fstream>
+#include <sstream>
+#include <pugixml.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+namespace bf = boost::filesystem;
+
+namespace
+{
+    vector<string> SplitTabs(const string &line)
+    {
+        vector<string> fields;
+        stringstream ss(line);
+        string item;
+        while (getline(ss, item, '\t'))
+        {
+            if (!item.empty())
+                fields.push_back(item);
+        }
+        return fields;
+    }
+
+    string Resolve(const bf::path &BasePath, const string &filename)
+    {
+        return (BasePath / bf::path(filename)).string();
+    }
+}
+
+string ObjectFromXML(const string &xmlfilename)
+{
+    using namespace pugi;
+    xml_document doc;
+    xml_parse_result result = doc.load_file(xmlfilename.c_str());
+
+    /* Move down the tree until the info -> star -> obj_id -> value is retrieved */
+    string ObjectName = doc.child("info").child("star").child("obj_id").attribute("val").value();
+    return ObjectName;
+}
+
+vector<string> ReadModelList(const string &listfilename)
+{
+    /*  need to get the path of the models list file */
+    bf::path BasePath = bf::path(listfilename).parent_path();
+
+    ifstream ModelsListFile(listfilename.c_str());
+    if (!ModelsListFile.is_open())
+    {
+        throw FileNotOpen("Cannot open list of model files for reading");
+    }
+
+    vector<string> ModelFilenames;
+    string line;
+    while (getline(ModelsListFile, line))
+    {
+        ModelFilenames.push_back(Resolve(BasePath, line));
+    }
+
+    return ModelFilenames;
+}
+
+vector<HostJob> ReadManifest(const string &filename)
+{
+    bf::path BasePath = bf::path(filename).parent_path();
+
+    ifstream ManifestFile(filename.c_str());
+    if (!ManifestFile.is_open())
+    {
+        throw FileNotOpen("Cannot open manifest for reading");
+    }
+
+    vector<HostJob> Jobs;
+    string line;
+    int LineNumber = 0;
+    while (getline(ManifestFile, line))
+    {
+        ++LineNumber;
+        const vector<string> fields = SplitTabs(line);
+        if (fields.empty() || (fields[0][0] == '#'))
+            continue;
+
+        if ((fields.size() < 2) || (fields.size() > 3))
+        {
+            stringstream ss;
+            ss << "Manifest line " << LineNumber << " needs a submodel and a list of add models";
+            throw UsageError(ss.str());
+        }
+
+        const size_t first = fields.size() - 2;
+
+        HostJob Job;
+        Job.SubModel = Resolve(BasePath, fields[first]);
+        Job.AddModels = ReadModelList(Resolve(BasePath, fields[first + 1]));
+        Job.ObjectName = first ? fields[0] : ObjectFromXML(Job.SubModel);
+        Jobs.push_back(Job);
+    }
+
+    if (Jobs.empty())
+    {
+        throw UsageError("Manifest lists no hosts");
+    }
+
+    return Jobs;
+}
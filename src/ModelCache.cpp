@@ -0,0 +1,199 @@
+#include "ModelCache.h"
+#include "Hash.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    const char Magic[8] = { 'S', 'Y', 'N', 'M', 'O', 'D', 'L', '1' };
+
+    /** Fixed part of the file header, followed by the parameters then the flux */
+    struct FileHeader
+    {
+        char magic[8];
+        boost::uint64_t nParams;
+        boost::uint64_t grid;
+        boost::uint64_t nSamples;
+    };
+}
+
+ModelCache::ModelCache(const string &directory, size_t MemoryLimit)
+: mDirectory(directory), mMemoryLimit(MemoryLimit), mMemoryUsed(0), mHits(0), mMisses(0)
+{
+}
+
+ModelKey ModelCache::MakeKey(const vector<double> &params, const vector<double> &Time)
+{
+    ModelKey key;
+    key.params = params;
+
+    const boost::uint64_t nSamples = Time.size();
+    key.grid = Fnv1a(&nSamples, sizeof(nSamples));
+    if (!Time.empty())
+    {
+        key.grid = Fnv1a(&Time[0], Time.size() * sizeof(double), key.grid);
+    }
+
+    key.hash = Fnv1a(&key.grid, sizeof(key.grid));
+    if (!params.empty())
+    {
+        key.hash = Fnv1a(&params[0], params.size() * sizeof(double), key.hash);
+    }
+
+    return key;
+}
+
+string ModelCache::Filename(const ModelKey &key) const
+{
+    char name[64];
+    sprintf(name, "model_%016llx.bin", static_cast<unsigned long long>(key.hash));
+    return mDirectory + "/" + name;
+}
+
+bool ModelCache::Find(const ModelKey &key, vector<double> &flux)
+{
+    if (FindInMemory(key, flux))
+    {
+        ++mHits;
+        return true;
+    }
+
+    if (!mDirectory.empty() && FindOnDisk(key, flux))
+    {
+        StoreInMemory(key, flux.empty() ? 0 : &flux[0], flux.size());
+        ++mHits;
+        return true;
+    }
+
+    ++mMisses;
+    return false;
+}
+
+void ModelCache::Store(const ModelKey &key, const double *flux, size_t n)
+{
+    StoreInMemory(key, flux, n);
+
+    if (!mDirectory.empty())
+    {
+        StoreOnDisk(key, flux, n);
+    }
+}
+
+bool ModelCache::FindInMemory(const ModelKey &key, vector<double> &flux) const
+{
+    map<boost::uint64_t, Entry>::const_iterator found = mEntries.find(key.hash);
+    if (found == mEntries.end())
+        return false;
+
+    const Entry &entry = found->second;
+    if ((entry.key.grid != key.grid) || (entry.key.params != key.params))
+        return false;
+
+    flux = entry.flux;
+    return true;
+}
+
+void ModelCache::StoreInMemory(const ModelKey &key, const double *flux, size_t n)
+{
+    const size_t nBytes = n * sizeof(double);
+    if ((nBytes > mMemoryLimit) || mEntries.count(key.hash))
+        return;
+
+    /*  drop the oldest entries until the new one fits */
+    while (mMemoryUsed + nBytes > mMemoryLimit)
+    {
+        map<boost::uint64_t, Entry>::iterator oldest = mEntries.find(mOrder.front());
+        mMemoryUsed -= oldest->second.flux.size() * sizeof(double);
+        mEntries.erase(oldest);
+        mOrder.pop_front();
+    }
+
+    Entry &entry = mEntries[key.hash];
+    entry.key = key;
+    entry.flux.assign(flux, flux + n);
+    mOrder.push_back(key.hash);
+    mMemoryUsed += nBytes;
+}
+
+bool ModelCache::FindOnDisk(const ModelKey &key, vector<double> &flux) const
+{
+    const string filename = Filename(key);
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || (info.st_size < (off_t)sizeof(FileHeader)))
+    {
+        close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    /*  the header, parameters and flux are all 8 byte aligned */
+    const FileHeader *header = static_cast<const FileHeader*>(mapped);
+    const double *params = reinterpret_cast<const double*>(header + 1);
+    const double *data = params + header->nParams;
+
+    bool valid = !memcmp(header->magic, Magic, sizeof(Magic))
+        && (header->nParams == key.params.size())
+        && (header->grid == key.grid)
+        && ((off_t)(sizeof(FileHeader) + (header->nParams + header->nSamples) * sizeof(double)) == info.st_size);
+
+    if (valid && !key.params.empty())
+    {
+        valid = !memcmp(params, &key.params[0], key.params.size() * sizeof(double));
+    }
+
+    if (valid)
+    {
+        flux.assign(data, data + header->nSamples);
+    }
+
+    munmap(mapped, info.st_size);
+    return valid;
+}
+
+void ModelCache::StoreOnDisk(const ModelKey &key, const double *flux, size_t n) const
+{
+    const string filename = Filename(key);
+
+    /*  write to a temporary file first so other jobs never see a partial model */
+    stringstream ss;
+    ss << filename << "." << getpid() << ".tmp";
+    const string tmpname = ss.str();
+
+    FileHeader header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.nParams = key.params.size();
+    header.grid = key.grid;
+    header.nSamples = n;
+
+    ofstream outfile(tmpname.c_str(), ios::binary);
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!key.params.empty())
+        outfile.write(reinterpret_cast<const char*>(&key.params[0]), key.params.size() * sizeof(double));
+    if (n > 0)
+        outfile.write(reinterpret_cast<const char*>(flux), n * sizeof(double));
+    outfile.close();
+
+    if (!outfile || rename(tmpname.c_str(), filename.c_str()))
+    {
+        cerr << "Cannot write model cache file " << filename << endl;
+        remove(tmpname.c_str());
+    }
+}
@@ -0,0 +1,180 @@
+#include "ModelSampler.h"
+#include "PhaseInterpolator.h"
+#include "SortedIndex.h"
+#include "WaspDateConverter.h"
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    /** Model phase and flux in order of increasing phase, as the interpolator needs
+     
+     Models generated on a phase grid are already in order so the sort is skipped */
+    void SortModel(const Lightcurve &model, ScratchVector &SortedPhase, ScratchVector &SortedFlux)
+    {
+        /*  get the phase values */
+        /*  the model SHOULD NOT contain nans */
+        const vector<double> &modelPhase = model.phase();
+
+        if (adjacent_find(modelPhase.begin(), modelPhase.end(), greater<double>()) == modelPhase.end())
+        {
+            SortedPhase.assign(modelPhase.begin(), modelPhase.end());
+            SortedFlux.assign(model.flux.begin(), model.flux.end());
+            return;
+        }
+
+        vector<pair<double, int>, ScratchAllocator<pair<double, int> > > SortedModelPhase;
+        SortedIndex(modelPhase, SortedModelPhase);
+        SortedPhase.resize(modelPhase.size());
+        SortedFlux.resize(modelPhase.size());
+        for (size_t i=0; i<modelPhase.size(); ++i)
+        {
+            SortedPhase[i] = SortedModelPhase[i].first;
+            SortedFlux[i] = model.flux[SortedModelPhase[i].second];
+        }
+    }
+
+    /** Time stamps closer than this (days, about 10ms) are the same sample
+     
+     Allows for rounding in the jd -> seconds -> jd round trip of the model */
+    const double SameTimeTolerance = 1E-7;
+
+    /** Julian date of sample i */
+    double SampleJD(const Lightcurve &lc, size_t i)
+    {
+        return lc.asWASP ? wd2jd(lc.jd[i]) : lc.jd[i];
+    }
+
+    /** True if the model was evaluated at the data's own time stamps
+     
+     The model ephemeris must match the one the data is folded on. Null
+     time stamps must be null in both. */
+    bool SharesTimeGrid(const Lightcurve &data, const Lightcurve &model, double period, double epoch)
+    {
+        if ((data.jd.size() != model.jd.size()) || (model.flux.size() != model.jd.size()))
+            return false;
+
+        if ((period != model.period) || (epoch != model.epoch))
+            return false;
+
+        for (size_t i=0; i<data.jd.size(); ++i)
+        {
+            const double dataJD = SampleJD(data, i);
+            const double modelJD = SampleJD(model, i);
+
+            if (isnan(dataJD) || isnan(modelJD))
+            {
+                if (isnan(dataJD) != isnan(modelJD))
+                    return false;
+            }
+            else if (fabs(dataJD - modelJD) > SameTimeTolerance)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+}
+
+ModelSampler::ModelSampler(const Lightcurve &data, const Lightcurve &model, double period, double epoch,
+                           const vector<double> *dataPhase)
+: mData(0), mModel(0), mDirect(false), mDataPhase(0)
+{
+    Reset(data, model, period, epoch, dataPhase);
+}
+
+ModelSampler::~ModelSampler()
+{
+}
+
+void ModelSampler::Reset(const Lightcurve &data, const Lightcurve &model, double period, double epoch,
+                         const vector<double> *dataPhase)
+{
+    Release();
+
+    mData = &data;
+    mModel = &model;
+    mDirect = SharesTimeGrid(data, model, period, epoch);
+    mDataPhase = (dataPhase && !dataPhase->empty()) ? &(*dataPhase)[0] : 0;
+
+    if (!mDirect)
+    {
+        ScratchVector SortedPhase, SortedFlux;
+        SortModel(model, SortedPhase, SortedFlux);
+        if (mInterpolator.get())
+            mInterpolator->Assign(SortedPhase, SortedFlux);
+        else
+            mInterpolator.reset(new PhaseInterpolator(SortedPhase, SortedFlux));
+
+        if (!mDataPhase)
+        {
+            const vector<double> &phase = data.phase(period, epoch);
+            mOwnPhase.assign(phase.begin(), phase.end());
+            mDataPhase = mOwnPhase.empty() ? 0 : &mOwnPhase[0];
+        }
+    }
+}
+
+void ModelSampler::Release()
+{
+    ScratchVector().swap(mOwnPhase);
+    if (mInterpolator.get())
+        mInterpolator->clear();
+}
+
+void ModelSampler::Sample(size_t first, size_t last, double *out) const
+{
+    if (mDirect)
+    {
+        for (size_t i=first; i<last; ++i)
+        {
+            out[i - first] = isnan(mData->jd[i]) ? mData->jd[i] : mModel->flux[i];
+        }
+    }
+    else if (last > first)
+    {
+        /*  null phases interpolate to null */
+        mInterpolator->Interpolate(mDataPhase + first, out, last - first);
+    }
+}
+
+double MeanFlux(const Lightcurve &data)
+{
+    double dataAv = 0;
+
+    if (data.hasValidity())
+    {
+        /*  sum the valid runs without testing each value, in the same
+            order as below so the result does not change */
+        const vector<IndexRange> &spans = data.ValidSpans();
+        for (vector<IndexRange>::const_iterator span=spans.begin(); span!=spans.end(); ++span)
+        {
+            for (size_t i=span->first; i<span->second; ++i)
+            {
+                dataAv += data.flux[i];
+            }
+        }
+
+        return dataAv / (double)data.nValid();
+    }
+
+    int dataCounter = 0;
+    for (Lightcurve::Column::const_iterator i=data.flux.begin();
+         i!=data.flux.end();
+         ++i)
+    {
+        if (!isnan(*i))
+        {
+            /*  not nan */
+            dataAv += *i;
+            ++dataCounter;
+        }
+    }
+
+    return dataAv / (double)dataCounter;
+}
@@ -0,0 +1,312 @@
+#include "ObjectIdIndex.h"
+#include "ToStringList.h"
+#include "Exceptions.h"
+#include "Hash.h"
+#include "CopyFileEfficiently.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <memory>
+#include <CCfits/CCfits>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace CCfits;
+
+namespace
+{
+    const char Magic[8] = { 'O', 'B', 'J', 'I', 'D', 'X', '0', '2' };
+
+    /** File header, followed by the entries then the identifiers */
+    struct FileHeader
+    {
+        char magic[8];
+        boost::uint64_t size;
+        boost::int64_t mtime;
+        boost::int64_t mtimeNsec;
+        boost::int64_t datasum;
+        boost::uint64_t nEntries;
+        boost::uint64_t nNameBytes;
+        boost::uint64_t checksum;
+    };
+
+    /** Orders entries by their identifier */
+    class EntryLess
+    {
+        public:
+            EntryLess(const char *names) : mNames(names) {}
+
+            template <typename Entry>
+            bool operator()(const Entry &a, const Entry &b) const
+            {
+                return Compare(a, mNames + b.offset, b.length) < 0;
+            }
+
+            template <typename Entry>
+            bool operator()(const Entry &a, const string &b) const
+            {
+                return Compare(a, b.data(), b.size()) < 0;
+            }
+
+        private:
+            template <typename Entry>
+            int Compare(const Entry &a, const char *b, size_t length) const
+            {
+                const int result = memcmp(mNames + a.offset, b, min<size_t>(a.length, length));
+                if (result)
+                    return result;
+
+                return a.length < length ? -1 : (a.length > length ? 1 : 0);
+            }
+
+            const char *mNames;
+    };
+
+    /** A single cell as a string, converted as ToStringList does */
+    template <typename T>
+    string CellString(Column &column, long row)
+    {
+        vector<T> data;
+        column.read(data, row + 1, row + 1);
+
+        stringstream ss;
+        ss << data.at(0);
+        return ss.str();
+    }
+
+    /** Reads the OBJ_ID column as strings, numeric identifiers are converted */
+    vector<string> ReadObjectIds(const string &filename)
+    {
+        auto_ptr<FITS> pInfile(new FITS(filename, Read));
+        ExtHDU &catalogue = pInfile->extension("CATALOGUE");
+        Column &objectIndexColumn = catalogue.column("OBJ_ID");
+
+        const long nObjects = UsedRows(catalogue);
+        int ColumnType = objectIndexColumn.type();
+        vector<string> ObjectIds;
+
+        if (ColumnType == Tstring)
+        {
+            objectIndexColumn.read(ObjectIds, 1, nObjects);
+        }
+        else if (ColumnType == Tint)
+        {
+            ObjectIds = ToStringList<int>(objectIndexColumn, nObjects);
+        }
+        else if (ColumnType == Tlong)
+        {
+            ObjectIds = ToStringList<long>(objectIndexColumn, nObjects);
+        }
+        else if (ColumnType == Tdouble)
+        {
+            ObjectIds = ToStringList<double>(objectIndexColumn, nObjects);
+        }
+
+        return ObjectIds;
+    }
+
+    /** DATASUM keyword of the catalogue, -1 if there is none
+     
+     Only the header is read. cfitsio keeps the keyword up to date when it
+     changes an HDU which has one */
+    boost::int64_t CatalogueDatasum(const string &filename)
+    {
+        FITS infile(filename, Read, string("CATALOGUE"), false);
+
+        string datasum;
+        try
+        {
+            infile.extension("CATALOGUE").readKey("DATASUM", datasum);
+        }
+        catch (HDU::NoSuchKeyword &)
+        {
+            return -1;
+        }
+
+        stringstream ss(datasum);
+        boost::uint64_t value = 0;
+        if (!(ss >> value))
+            return -1;
+
+        return value;
+    }
+
+    /** Checksum of the entries and identifiers */
+    template <typename Entry>
+    boost::uint64_t Checksum(const vector<Entry> &entries, const vector<char> &names)
+    {
+        boost::uint64_t hash = Fnv1aOffset;
+        if (!entries.empty())
+            hash = Fnv1a(&entries[0], entries.size() * sizeof(Entry), hash);
+        if (!names.empty())
+            hash = Fnv1a(&names[0], names.size(), hash);
+        return hash;
+    }
+}
+
+ObjectIdIndex::ObjectIdIndex(const string &filename)
+{
+    const string sidecar = filename + ".objidx";
+
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+    {
+        throw FileNotOpen("Cannot find " + filename);
+    }
+
+    SourceStamp stamp;
+    stamp.size = info.st_size;
+    stamp.mtime = info.st_mtim.tv_sec;
+    stamp.mtimeNsec = info.st_mtim.tv_nsec;
+    stamp.datasum = CatalogueDatasum(filename);
+
+    if (Load(sidecar, stamp))
+    {
+        cout << "Object index loaded from " << sidecar << endl;
+        return;
+    }
+
+    Build(filename);
+    Save(sidecar, stamp);
+    cout << "Object index of " << mEntries.size() << " objects built" << endl;
+}
+
+string ObjectIdIndex::ObjectId(ExtHDU &catalogue, long row)
+{
+    Column &objectIndexColumn = catalogue.column("OBJ_ID");
+
+    const int ColumnType = objectIndexColumn.type();
+    if (ColumnType == Tint)
+        return CellString<int>(objectIndexColumn, row);
+    else if (ColumnType == Tlong)
+        return CellString<long>(objectIndexColumn, row);
+    else if (ColumnType == Tdouble)
+        return CellString<double>(objectIndexColumn, row);
+
+    return CellString<string>(objectIndexColumn, row);
+}
+
+long ObjectIdIndex::Find(const string &objName) const
+{
+    if (mEntries.empty())
+        return -1;
+
+    const EntryLess less(&mNames[0]);
+    vector<Entry>::const_iterator found = lower_bound(mEntries.begin(), mEntries.end(), objName, less);
+    if ((found == mEntries.end()) || (found->length != objName.size())
+            || memcmp(&mNames[found->offset], objName.data(), objName.size()))
+        return -1;
+
+    return found->row;
+}
+
+void ObjectIdIndex::Build(const string &filename)
+{
+    const vector<string> ObjectIds = ReadObjectIds(filename);
+
+    /*  sort the rows by identifier, equal identifiers stay in row order */
+    vector<pair<string, boost::uint32_t> > sorted(ObjectIds.size());
+    for (size_t i=0; i<ObjectIds.size(); ++i)
+    {
+        sorted[i] = make_pair(ObjectIds[i], boost::uint32_t(i));
+    }
+    sort(sorted.begin(), sorted.end());
+
+    mEntries.clear();
+    mNames.clear();
+    for (size_t i=0; i<sorted.size(); ++i)
+    {
+        if ((i > 0) && (sorted[i].first == sorted[i - 1].first))
+            continue;
+
+        Entry entry;
+        entry.offset = mNames.size();
+        entry.length = sorted[i].first.size();
+        entry.row = sorted[i].second;
+        mEntries.push_back(entry);
+        mNames.insert(mNames.end(), sorted[i].first.begin(), sorted[i].first.end());
+    }
+}
+
+bool ObjectIdIndex::Load(const string &sidecar, const SourceStamp &stamp)
+{
+    ifstream infile(sidecar.c_str(), ios::binary);
+    if (!infile.is_open())
+        return false;
+
+    FileHeader header;
+    infile.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!infile || memcmp(header.magic, Magic, sizeof(Magic)) || (header.size != stamp.size)
+            || (header.mtime != stamp.mtime) || (header.mtimeNsec != stamp.mtimeNsec)
+            || (header.datasum != stamp.datasum))
+        return false;
+
+    /*  make sure the lengths are sensible before allocating anything */
+    struct stat info;
+    if ((stat(sidecar.c_str(), &info) != 0)
+            || ((boost::uint64_t)info.st_size != sizeof(header) + header.nEntries * sizeof(Entry) + header.nNameBytes))
+        return false;
+
+    vector<Entry> entries(header.nEntries);
+    vector<char> names(header.nNameBytes);
+    if (!entries.empty())
+        infile.read(reinterpret_cast<char*>(&entries[0]), entries.size() * sizeof(Entry));
+    if (!names.empty())
+        infile.read(&names[0], names.size());
+
+    if (!infile || (Checksum(entries, names) != header.checksum))
+        return false;
+
+    for (size_t i=0; i<entries.size(); ++i)
+    {
+        if (entries[i].offset + entries[i].length > names.size())
+            return false;
+    }
+
+    mEntries.swap(entries);
+    mNames.swap(names);
+    return true;
+}
+
+void ObjectIdIndex::Save(const string &sidecar, const SourceStamp &stamp) const
+{
+    /*  write to a temporary file first so other jobs never see a partial index */
+    stringstream ss;
+    ss << sidecar << "." << getpid() << ".tmp";
+    const string tmpname = ss.str();
+
+    FileHeader header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.size = stamp.size;
+    header.mtime = stamp.mtime;
+    header.mtimeNsec = stamp.mtimeNsec;
+    header.datasum = stamp.datasum;
+    header.nEntries = mEntries.size();
+    header.nNameBytes = mNames.size();
+    header.checksum = Checksum(mEntries, mNames);
+
+    ofstream outfile(tmpname.c_str(), ios::binary);
+    if (!outfile.is_open())
+    {
+        cerr << "Cannot write object index " << sidecar << endl;
+        return;
+    }
+
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!mEntries.empty())
+        outfile.write(reinterpret_cast<const char*>(&mEntries[0]), mEntries.size() * sizeof(Entry));
+    if (!mNames.empty())
+        outfile.write(&mNames[0], mNames.size());
+    outfile.close();
+
+    if (!outfile || rename(tmpname.c_str(), sidecar.c_str()))
+    {
+        cerr << "Cannot write object index " << sidecar << endl;
+        remove(tmpname.c_str());
+    }
+}
@@ -0,0 +1,281 @@
+#include "Overlay.h"
+#include "Exceptions.h"
+#include "ObjectSkipDefs.h"
+#include "ModelSampler.h"
+#include "Philox.h"
+#include "constants.h"
+#include "WaspDateConverter.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+using namespace CCfits;
+
+namespace ad = AlterDetrending;
+
+namespace
+{
+    /** Values are compared bit for bit so NaNs and signed zeros survive */
+    bool SameValue(double a, double b)
+    {
+        return !memcmp(&a, &b, sizeof(double));
+    }
+
+    /** Model value outside the transit, 1 plus the noise added when the
+     *  model was generated */
+    void NoiseSamples(double noise, const Philox &randGenerator, size_t n, vector<double> &samples)
+    {
+        samples.assign(n, 1.);
+        if (noise == 0)
+            return;
+
+        for (size_t i=0; i<n; ++i)
+        {
+            samples[i] += noise * randGenerator.Normal(i);
+        }
+    }
+
+    /** RebuildSynthetic with the noise samples already drawn */
+    void RebuildFlux(const Lightcurve::Column &jd, Lightcurve::Column &flux, const OverlayRecipe &recipe,
+                     const vector<double> &subSamples, const vector<double> &addSamples)
+    {
+        const double nan = numeric_limits<double>::quiet_NaN();
+
+        for (size_t i=0; i<flux.size(); ++i)
+        {
+            const double removed = ApplyModel(flux[i], recipe.HostMean, subSamples[i], -1.);
+            if (isnan(jd[i]) || isnan(removed))
+            {
+                flux[i] = nan;
+                continue;
+            }
+
+            /*  as HostContext, the normalisation is done before adding */
+            const double normalised = removed / recipe.RemovedMean;
+            flux[i] = ((normalised + addSamples[i]) - 1.0) * recipe.RemovedMean;
+        }
+    }
+}
+
+void RebuildSynthetic(const Lightcurve::Column &jd, Lightcurve::Column &flux, const OverlayRecipe &recipe,
+                      unsigned int seed)
+{
+    vector<double> subSamples, addSamples;
+    NoiseSamples(recipe.SubNoise, Philox(seed, recipe.SubModelId), flux.size(), subSamples);
+    NoiseSamples(recipe.AddNoise, Philox(seed, recipe.ModelId), flux.size(), addSamples);
+
+    RebuildFlux(jd, flux, recipe, subSamples, addSamples);
+}
+
+OverlayWriter::OverlayWriter(const string &filename, const string &SourceFilename, long nFrames, unsigned int seed)
+: mTable(0), mNFrames(nFrames), mNRows(0), mSeed(seed)
+{
+    /*  exclamation mark ensures the file is overwritten if it exists */
+    mFile = auto_ptr<FITS>(new FITS("!" + filename, Write));
+
+    vector<string> names, formats, units;
+    names.push_back("HOSTROW");     formats.push_back("1J");  units.push_back("");
+    names.push_back("OBJ_ID");      formats.push_back("26A"); units.push_back("");
+    names.push_back("FLUX_MEAN");   formats.push_back("1D");  units.push_back("");
+    names.push_back("FAKE_RP");     formats.push_back("1D");  units.push_back("");
+    names.push_back("FAKE_RS");     formats.push_back("1D");  units.push_back("");
+    names.push_back("FAKE_PERIOD"); formats.push_back("1D");  units.push_back("");
+    names.push_back("FAKE_A");      formats.push_back("1D");  units.push_back("");
+    names.push_back("FAKE_I");      formats.push_back("1D");  units.push_back("deg");
+    names.push_back("FAKE_EPOCH");  formats.push_back("1D");  units.push_back("s");
+    names.push_back("FAKE_DEPTH");  formats.push_back("1D");  units.push_back("");
+    names.push_back("FAKE_WIDTH");  formats.push_back("1D");  units.push_back("");
+    names.push_back("SKIPDET");     formats.push_back("1J");  units.push_back("");
+    names.push_back("HOSTMEAN");    formats.push_back("1D");  units.push_back("");
+    names.push_back("REMMEAN");     formats.push_back("1D");  units.push_back("");
+    names.push_back("SUBNOISE");    formats.push_back("1D");  units.push_back("");
+    names.push_back("ADDNOISE");    formats.push_back("1D");  units.push_back("");
+    names.push_back("SUBNOISEID");  formats.push_back("1J");  units.push_back("");
+    names.push_back("NOISEID");     formats.push_back("1J");  units.push_back("");
+    names.push_back("DELTAIDX");    formats.push_back("1PJ"); units.push_back("");
+    names.push_back("DELTAFLUX");   formats.push_back("1PD"); units.push_back("");
+
+    mTable = mFile->addTable("OVERLAY", 0, names, formats, units);
+
+    mFile->pHDU().addKey("SOURCE", SourceFilename, "File holding the host lightcurves");
+    mFile->pHDU().addKey("NFRAMES", mNFrames, "Frames per lightcurve");
+    mFile->pHDU().addKey("NOISSEED", static_cast<long>(seed), "Seed for the synthetic noise");
+}
+
+void OverlayWriter::Add(long HostRow, const Lightcurve &host, const OverlayRecipe &recipe, const Lightcurve &subModel,
+                        const Lightcurve &addModel, const Lightcurve &synthetic)
+{
+    if (((long)host.flux.size() != mNFrames) || ((long)synthetic.flux.size() != mNFrames))
+        throw OverlayError("Lightcurve does not match the number of frames");
+
+    vector<double> subSamples, addSamples;
+    NoiseSamples(recipe.SubNoise, Philox(mSeed, recipe.SubModelId), mNFrames, subSamples);
+    NoiseSamples(recipe.AddNoise, Philox(mSeed, recipe.ModelId), mNFrames, addSamples);
+
+    Lightcurve::Column rebuilt(host.flux);
+    RebuildFlux(host.jd, rebuilt, recipe, subSamples, addSamples);
+
+    /*  models not sampled on the host's time stamps cannot be checked, so
+     *  every frame is kept */
+    const bool sampled = ((long)subModel.flux.size() == mNFrames) && ((long)addModel.flux.size() == mNFrames);
+
+    vector<int> index;
+    for (long i=0; i<mNFrames; ++i)
+    {
+        const bool inTransit = !sampled || (subModel.flux[i] != subSamples[i]) || (addModel.flux[i] != addSamples[i]);
+
+        /*  anything the reader would not rebuild exactly is kept too */
+        if (inTransit || !SameValue(rebuilt[i], synthetic.flux[i]))
+            index.push_back(i);
+    }
+
+    valarray<int> DeltaIndex(index.size());
+    valarray<double> DeltaFlux(index.size());
+    for (size_t i=0; i<index.size(); ++i)
+    {
+        DeltaIndex[i] = index[i];
+        DeltaFlux[i] = synthetic.flux[index[i]];
+    }
+
+    mHostRows.push_back(HostRow);
+    mRecipes.push_back(recipe);
+    mDeltaIndex.push_back(DeltaIndex);
+    mDeltaFlux.push_back(DeltaFlux);
+    mCatalogue.Append(synthetic, ad::skipboth);
+}
+
+void OverlayWriter::Flush()
+{
+    if (mHostRows.empty())
+        return;
+
+    vector<double> HostMean, RemovedMean, SubNoise, AddNoise;
+    vector<long> SubModelId, ModelId;
+    for (size_t i=0; i<mRecipes.size(); ++i)
+    {
+        HostMean.push_back(mRecipes[i].HostMean);
+        RemovedMean.push_back(mRecipes[i].RemovedMean);
+        SubNoise.push_back(mRecipes[i].SubNoise);
+        AddNoise.push_back(mRecipes[i].AddNoise);
+        SubModelId.push_back(mRecipes[i].SubModelId);
+        ModelId.push_back(mRecipes[i].ModelId);
+    }
+
+    const long FirstRow = mNRows + 1;
+    mTable->column("HOSTROW").write(mHostRows, FirstRow);
+    mTable->column("HOSTMEAN").write(HostMean, FirstRow);
+    mTable->column("REMMEAN").write(RemovedMean, FirstRow);
+    mTable->column("SUBNOISE").write(SubNoise, FirstRow);
+    mTable->column("ADDNOISE").write(AddNoise, FirstRow);
+    mTable->column("SUBNOISEID").write(SubModelId, FirstRow);
+    mTable->column("NOISEID").write(ModelId, FirstRow);
+    mCatalogue.Write(*mTable, mNRows);
+    mTable->column("DELTAIDX").writeArrays(mDeltaIndex, FirstRow);
+    mTable->column("DELTAFLUX").writeArrays(mDeltaFlux, FirstRow);
+
+    mNRows += mHostRows.size();
+    mHostRows.clear();
+    mRecipes.clear();
+    mDeltaIndex.clear();
+    mDeltaFlux.clear();
+    mCatalogue = CatalogueBuffer();
+}
+
+OverlayReader::OverlayReader(const string &filename, const string &SourceFilename)
+{
+    mFile = auto_ptr<FITS>(new FITS(filename, CCfits::Read));
+
+    string source = SourceFilename;
+    if (source.empty())
+        mFile->pHDU().readKey("SOURCE", source);
+
+    mFile->pHDU().readKey("NFRAMES", mNFrames);
+
+    long seed = 0;
+    mFile->pHDU().readKey("NOISSEED", seed);
+    mSeed = static_cast<unsigned int>(seed);
+    mNRows = mFile->extension("OVERLAY").rows();
+
+    mSource = auto_ptr<FITS>(new FITS(source, CCfits::Read));
+    if (mSource->extension("FLUX").axis(0) != mNFrames)
+    {
+        stringstream ss;
+        ss << "Overlay " << filename << " was not made from " << source;
+        throw OverlayError(ss.str());
+    }
+}
+
+template <typename T>
+T OverlayReader::ReadCell(const string &column, long i)
+{
+    vector<T> data;
+    mFile->extension("OVERLAY").column(column).read(data, i + 1, i + 1);
+    return data[0];
+}
+
+long OverlayReader::HostRow(long i)
+{
+    return ReadCell<long>("HOSTROW", i);
+}
+
+Lightcurve OverlayReader::Read(long i)
+{
+    if ((i < 0) || (i >= mNRows))
+        throw OverlayError("Synthetic index out of range");
+
+    const long firstElement = HostRow(i) * mNFrames + 1;
+    valarray<double> flux, fluxerr, hjd;
+    mSource->extension("FLUX").read(flux, firstElement, mNFrames);
+    mSource->extension("FLUXERR").read(fluxerr, firstElement, mNFrames);
+    mSource->extension("HJD").read(hjd, firstElement, mNFrames);
+
+    Lightcurve returnval(mNFrames);
+    for (long j=0; j<mNFrames; ++j)
+    {
+        returnval.flux[j] = flux[j];
+        returnval.jd[j] = hjd[j];
+        returnval.fluxerr[j] = fluxerr[j];
+    }
+
+    /*  outside the transits the synthetic follows from the host and
+     *  the regenerated noise, inside them the flux is stored */
+    OverlayRecipe recipe;
+    recipe.HostMean = ReadCell<double>("HOSTMEAN", i);
+    recipe.RemovedMean = ReadCell<double>("REMMEAN", i);
+    recipe.SubNoise = ReadCell<double>("SUBNOISE", i);
+    recipe.AddNoise = ReadCell<double>("ADDNOISE", i);
+    recipe.SubModelId = static_cast<unsigned int>(ReadCell<long>("SUBNOISEID", i));
+    recipe.ModelId = static_cast<unsigned int>(ReadCell<long>("NOISEID", i));
+    RebuildSynthetic(returnval.jd, returnval.flux, recipe, mSeed);
+
+    ExtHDU &table = mFile->extension("OVERLAY");
+    vector<valarray<int> > DeltaIndex;
+    vector<valarray<double> > DeltaFlux;
+    table.column("DELTAIDX").readArrays(DeltaIndex, i + 1, i + 1);
+    table.column("DELTAFLUX").readArrays(DeltaFlux, i + 1, i + 1);
+
+    if (DeltaIndex[0].size() != DeltaFlux[0].size())
+        throw OverlayError("Overlay index and flux differences do not match");
+
+    for (size_t j=0; j<DeltaIndex[0].size(); ++j)
+    {
+        const int frame = DeltaIndex[0][j];
+        if ((frame < 0) || (frame >= mNFrames))
+            throw OverlayError("Overlay frame index out of range");
+
+        returnval.flux[frame] = DeltaFlux[0][j];
+    }
+    returnval.UpdateValidity();
+
+    returnval.obj_id = ReadCell<string>("OBJ_ID", i);
+    returnval.radius = ReadCell<double>("FAKE_RP", i);
+    returnval.rstar = ReadCell<double>("FAKE_RS", i);
+    returnval.period = ReadCell<double>("FAKE_PERIOD", i);
+    returnval.sep = ReadCell<double>("FAKE_A", i);
+    returnval.inclination = ReadCell<double>("FAKE_I", i) / degreesInRadian;
+    returnval.epoch = wd2jd(ReadCell<double>("FAKE_EPOCH", i));
+
+    return returnval;
+}
@@ -0,0 +1,78 @@
+#include "PhaseInterpolator.h"
+#include "Exceptions.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+PhaseInterpolator::PhaseInterpolator(const vector<double> &x, const vector<double> &y)
+: mX(x.begin(), x.end()), mY(y.begin(), y.end()), mInvStep(0), mUniform(false)
+{
+    Init();
+}
+
+PhaseInterpolator::PhaseInterpolator(ScratchVector &x, ScratchVector &y)
+: mInvStep(0), mUniform(false)
+{
+    Assign(x, y);
+}
+
+void PhaseInterpolator::Assign(ScratchVector &x, ScratchVector &y)
+{
+    mX.swap(x);
+    mY.swap(y);
+    ScratchVector().swap(x);
+    ScratchVector().swap(y);
+    Init();
+}
+
+void PhaseInterpolator::clear()
+{
+    ScratchVector().swap(mX);
+    ScratchVector().swap(mY);
+}
+
+void PhaseInterpolator::Init()
+{
+    mInvStep = 0;
+    mUniform = false;
+
+    if ((mX.size() < 2) || (mX.size() != mY.size()))
+        throw InterpolationError("At least two model points are needed");
+
+    mLastIndex = mX.size() - 2;
+
+    /*  uniform if no point is more than a quarter step from its grid
+     *  position, then the estimated interval is never more than one out */
+    const double step = (mX.back() - mX.front()) / (mX.size() - 1);
+    if (step > 0)
+    {
+        double maxOffset = 0;
+        for (size_t i=0; i<mX.size(); ++i)
+        {
+            maxOffset = max(maxOffset, fabs(mX[i] - (mX.front() + i * step)));
+        }
+
+        mUniform = maxOffset <= 0.25 * step;
+        mInvStep = 1. / step;
+    }
+}
+
+void PhaseInterpolator::Interpolate(const double *x, double *y, size_t n) const
+{
+    /*  no data dependent branches inside the loops so they can be vectorised */
+    if (mUniform)
+    {
+        for (size_t i=0; i<n; ++i)
+        {
+            y[i] = Evaluate(x[i], UniformIndex(x[i]));
+        }
+    }
+    else
+    {
+        for (size_t i=0; i<n; ++i)
+        {
+            y[i] = Evaluate(x[i], SearchIndex(x[i]));
+        }
+    }
+}
@@ -0,0 +1,216 @@
+#include "ScratchArena.h"
+#include "config.h"
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+    const size_t Alignment = 64;
+
+    /** Smallest block worth allocating */
+    const size_t MinBlockSize = 1 << 16;
+
+    size_t RoundUp(size_t bytes)
+    {
+        return (bytes + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    /** Space before each piece of scratch memory holding its arena, a
+        whole alignment unit so the memory stays aligned */
+    const size_t HeaderSize = Alignment;
+
+    ScratchArenas *&InstalledArenas()
+    {
+        static ScratchArenas *arenas = 0;
+        return arenas;
+    }
+
+    /** The arenas own their memory, nothing to do when a thread exits */
+    void KeepArena(ScratchArena *)
+    {
+    }
+
+    int MaxThreads()
+    {
+#ifdef USE_OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+}
+
+ScratchArena::ScratchArena(size_t capacity)
+: mOffset(0), mUsed(0), mPeak(0)
+{
+    AddBlock(capacity);
+}
+
+ScratchArena::~ScratchArena()
+{
+    for (size_t i=0; i<mBlocks.size(); ++i)
+    {
+        free(mBlocks[i].memory);
+    }
+}
+
+void ScratchArena::AddBlock(size_t size)
+{
+    size = RoundUp(max(size, MinBlockSize));
+
+    void *memory = 0;
+    if (posix_memalign(&memory, Alignment, size))
+        throw std::bad_alloc();
+
+    Block block;
+    block.memory = static_cast<char*>(memory);
+    block.size = size;
+    mBlocks.push_back(block);
+    mOffset = 0;
+}
+
+void *ScratchArena::Allocate(size_t bytes)
+{
+    bytes = RoundUp(bytes);
+
+    /*  only the last block has space left */
+    if (mOffset + bytes > mBlocks.back().size)
+        AddBlock(max(bytes, mBlocks.back().size));
+
+    void *memory = mBlocks.back().memory + mOffset;
+    mOffset += bytes;
+    mUsed += bytes;
+    mPeak = max(mPeak, mUsed);
+    return memory;
+}
+
+void ScratchArena::Reset()
+{
+    /*  replace the blocks by one which holds everything used so far */
+    if (mBlocks.size() > 1)
+    {
+        for (size_t i=0; i<mBlocks.size(); ++i)
+        {
+            free(mBlocks[i].memory);
+        }
+
+        mBlocks.clear();
+        AddBlock(mPeak);
+    }
+
+    mOffset = 0;
+    mUsed = 0;
+}
+
+size_t ScratchArena::capacity() const
+{
+    size_t total = 0;
+    for (size_t i=0; i<mBlocks.size(); ++i)
+    {
+        total += mBlocks[i].size;
+    }
+
+    return total;
+}
+
+ScratchArena *ScratchArena::Current()
+{
+    ScratchArenas *arenas = ScratchArenas::Installed();
+    return arenas ? &arenas->Current() : 0;
+}
+
+ScratchArenas::ScratchArenas(size_t capacity)
+: mCapacity(capacity), mNClaimed(0), mCurrent(KeepArena)
+{
+    for (int i=0; i<MaxThreads(); ++i)
+    {
+        mArenas.push_back(new ScratchArena(capacity));
+    }
+
+    InstalledArenas() = this;
+}
+
+ScratchArenas::~ScratchArenas()
+{
+    InstalledArenas() = 0;
+}
+
+void ScratchArenas::Reset()
+{
+    for (size_t i=0; i<mArenas.size(); ++i)
+    {
+        mArenas[i].Reset();
+    }
+}
+
+size_t ScratchArenas::used() const
+{
+    size_t total = 0;
+    for (size_t i=0; i<mArenas.size(); ++i)
+    {
+        total += mArenas[i].used();
+    }
+
+    return total;
+}
+
+size_t ScratchArenas::peak() const
+{
+    size_t total = 0;
+    for (size_t i=0; i<mArenas.size(); ++i)
+    {
+        total += mArenas[i].peak();
+    }
+
+    return total;
+}
+
+ScratchArena &ScratchArenas::Current()
+{
+    ScratchArena *arena = mCurrent.get();
+    if (!arena)
+    {
+        /*  one arena was made for each OpenMP thread up front, other
+            threads get new ones */
+        boost::mutex::scoped_lock lock(mMutex);
+        if (mNClaimed == mArenas.size())
+            mArenas.push_back(new ScratchArena(mCapacity));
+
+        arena = &mArenas[mNClaimed++];
+        mCurrent.reset(arena);
+    }
+
+    return *arena;
+}
+
+ScratchArenas *ScratchArenas::Installed()
+{
+    return InstalledArenas();
+}
+
+void *ScratchAllocate(size_t bytes)
+{
+    ScratchArena *arena = ScratchArena::Current();
+
+    char *memory = static_cast<char*>(arena ? arena->Allocate(bytes + HeaderSize)
+                                            : ::operator new(bytes + HeaderSize));
+    *reinterpret_cast<ScratchArena**>(memory) = arena;
+    return memory + HeaderSize;
+}
+
+void ScratchFree(void *p)
+{
+    if (!p)
+        return;
+
+    char *memory = static_cast<char*>(p) - HeaderSize;
+    if (!*reinterpret_cast<ScratchArena**>(memory))
+        ::operator delete(memory);
+}
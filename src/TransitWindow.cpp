@@ -0,0 +1,72 @@
+#include "TransitWindow.h"
+#include "FuncSquare.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+double TransitHalfWidth(double period, double normalisedDistance, double p, double inclination)
+{
+    const double quarter = period / 4.;
+
+    const double sini = sin(inclination);
+    const double InsideSqrt = square((1. + p) / normalisedDistance) - square(cos(inclination));
+    if (InsideSqrt <= 0)
+    {
+        /*  never reaches first contact */
+        return 0.;
+    }
+
+    const double InsideAsin = sqrt(InsideSqrt) / sini;
+    if (!(InsideAsin < 1.))
+    {
+        return quarter;
+    }
+
+    const double halfWidth = period / (2. * M_PI) * asin(InsideAsin);
+    return min(halfWidth, quarter);
+}
+
+bool FindTransitWindows(const vector<double> &Time, double period, double halfWidth, vector<IndexRange> &windows)
+{
+    windows.clear();
+    if (Time.empty())
+        return true;
+
+    /*  the binary search needs a sorted grid, nans compare false */
+    for (size_t i=0; i<Time.size(); ++i)
+    {
+        if (!(Time[i] == Time[i]))
+            return false;
+
+        if ((i > 0) && (Time[i] < Time[i-1]))
+            return false;
+    }
+
+    if (halfWidth <= 0)
+        return true;
+
+    /*  pad the windows slightly so rounding never clips a sample */
+    const double pad = 1E-6 * period;
+    const double width = halfWidth + pad;
+
+    const long firstTransit = static_cast<long>(ceil((Time.front() - width) / period));
+    const long lastTransit = static_cast<long>(floor((Time.back() + width) / period));
+
+    vector<double>::const_iterator start = Time.begin();
+    for (long n=firstTransit; n<=lastTransit; ++n)
+    {
+        const double centre = n * period;
+        start = lower_bound(start, Time.end(), centre - width);
+        vector<double>::const_iterator end = upper_bound(start, Time.end(), centre + width);
+
+        if (start != end)
+        {
+            windows.push_back(IndexRange(start - Time.begin(), end - Time.begin()));
+        }
+
+        start = end;
+    }
+
+    return true;
+}
@@ -5,6 +5,7 @@
 #include <string>
 #include <algorithm>
 #include "Exceptions.h"
+#include "FluxModel.h"
 
 using namespace std;
 using namespace pugi;
@@ -271,6 +272,46 @@ void Config::Config::m_getNoise()
 
 }
 
+/** Flux engine used to evaluate the model
+ *
+ * Optional, defaults to the riemann integrator. The table engine
+ * also takes an interpolation tolerance, default 1e-5 */
+void Config::Config::m_getEngine()
+{
+	xml_node EngineNode = SimulationNode.child("engine");
+	engine = FluxEngine::FromString(EngineNode.attribute("val").value());
+
+	xml_attribute ToleranceAttr = EngineNode.attribute("tolerance");
+	tolerance = ToleranceAttr ? ToleranceAttr.as_double() : 1E-5;
+
+	if (tolerance <= 0)
+		throw XMLException("Flux table tolerance must be positive");
+}
+
+/** Time sampling for models generated without a data set
+ *
+ * Optional, defaults to the uniform grid. The adaptive grid
+ * takes the interpolation error bound as a tolerance, default 1e-6 */
+void Config::Config::m_getPhaseGrid()
+{
+	xml_node PhaseGridNode = SimulationNode.child("phasegrid");
+	string name = PhaseGridNode.attribute("val").value();
+	Upper(name);
+
+	if (name.empty() || (name == "UNIFORM"))
+		phasegrid = PhaseGrid::uniform;
+	else if (name == "ADAPTIVE")
+		phasegrid = PhaseGrid::adaptive;
+	else
+		throw XMLException("Unknown phase grid: " + name);
+
+	xml_attribute ToleranceAttr = PhaseGridNode.attribute("tolerance");
+	phaseTolerance = ToleranceAttr ? ToleranceAttr.as_double() : 1E-6;
+
+	if (phaseTolerance <= 0)
+		throw XMLException("Phase grid tolerance must be positive");
+}
+
 void Config::Config::m_getAll()
 {
     m_getPlanetRadius();
@@ -283,5 +324,7 @@ void Config::Config::m_getAll()
     m_getDR();
     m_getMidpoint();
 	m_getNoise();
+	m_getEngine();
+	m_getPhaseGrid();
     m_getMaxTime();                   // must come after m_getPeriod()
 }
@@ -0,0 +1,82 @@
+/*  Micro benchmark of the Riemann intensity integral
+ *
+ *  Compares the original scalar IntegratedI with the vectorised
+ *  IntegratedIKernel over a range of integration limits typical of
+ *  a transit model with dr = 0.001 */
+#include "FuncIntensity.h"
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    double Seconds(clock_t start)
+    {
+        return double(clock() - start) / CLOCKS_PER_SEC;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    /*  WASP-12 coefficients */
+    vector<double> coeffs(5);
+    coeffs[1] = 0.61764;
+    coeffs[2] = -0.11308;
+    coeffs[3] = 0.331026;
+    coeffs[4] = -0.198393;
+    coeffs[0] = 1. - coeffs[1] - coeffs[2] - coeffs[3] - coeffs[4];
+
+    const double dr = 0.001;
+    const double p = 0.1115;
+    const int nRepeats = 20;
+
+    vector<double> limits;
+    for (double z=0.; z<1.-p; z+=0.0005)
+    {
+        limits.push_back(z);
+    }
+
+    double referenceSum = 0, kernelSum = 0, maxDifference = 0;
+
+    clock_t start = clock();
+    for (int repeat=0; repeat<nRepeats; ++repeat)
+    {
+        for (size_t i=0; i<limits.size(); ++i)
+        {
+            referenceSum += IntegratedI(dr, coeffs, limits[i]-p, limits[i]+p);
+        }
+    }
+    const double referenceTime = Seconds(start);
+
+    start = clock();
+    for (int repeat=0; repeat<nRepeats; ++repeat)
+    {
+        for (size_t i=0; i<limits.size(); ++i)
+        {
+            kernelSum += IntegratedIKernel(dr, coeffs, limits[i]-p, limits[i]+p);
+        }
+    }
+    const double kernelTime = Seconds(start);
+
+    for (size_t i=0; i<limits.size(); ++i)
+    {
+        const double difference = IntegratedI(dr, coeffs, limits[i]-p, limits[i]+p)
+            - IntegratedIKernel(dr, coeffs, limits[i]-p, limits[i]+p);
+        maxDifference = max(maxDifference, fabs(difference));
+    }
+
+    const long nCalls = nRepeats * limits.size();
+    cout << "Kernel: " << IntensityKernelName() << endl;
+    cout << "Scalar IntegratedI: " << referenceTime / nCalls * 1E6 << " us per call" << endl;
+    cout << "IntegratedIKernel: " << kernelTime / nCalls * 1E6 << " us per call" << endl;
+    cout << "Speedup: " << referenceTime / kernelTime << "x" << endl;
+    cout << "Largest difference: " << maxDifference << endl;
+
+    /*  printing the sums stops them being optimised away */
+    cout << "Sums: " << referenceSum << " " << kernelSum << endl;
+
+    return 0;
+}
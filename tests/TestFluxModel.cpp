@@ -0,0 +1,66 @@
+#include <UnitTest++/UnitTest++.h>
+#include "FluxModel.h"
+#include <cmath>
+
+struct FluxFixture
+{
+    FluxFixture() : coeffs(5)
+    {
+        /*  WASP-12 coefficients */
+        coeffs[1] = 0.61764;
+        coeffs[2] = -0.11308;
+        coeffs[3] = 0.331026;
+        coeffs[4] = -0.198393;
+        coeffs[0] = 1. - coeffs[1] - coeffs[2] - coeffs[3] - coeffs[4];
+    }
+
+    std::vector<double> coeffs;
+};
+
+TEST_FIXTURE(FluxFixture, TestOutOfTransit)
+{
+    FluxModel model(coeffs, 0.001, FluxEngine::analytic);
+    CHECK_EQUAL(model.Flux(1.5, 0.1), 1.);
+}
+
+TEST_FIXTURE(FluxFixture, TestAnalyticMatchesRiemann)
+{
+    FluxModel reference(coeffs, 1E-6, FluxEngine::riemann);
+    FluxModel analytic(coeffs, 1E-6, FluxEngine::analytic);
+
+    for (double z=0.05; z<1.1; z+=0.05)
+    {
+        CHECK_CLOSE(reference.Flux(z, 0.1), analytic.Flux(z, 0.1), 1E-6);
+    }
+}
+
+TEST_FIXTURE(FluxFixture, TestCumulativeMatchesAnalytic)
+{
+    FluxModel cumulative(coeffs, 0.001, FluxEngine::cumulative);
+    FluxModel analytic(coeffs, 0.001, FluxEngine::analytic);
+
+    for (double z=0.05; z<1.1; z+=0.05)
+    {
+        CHECK_CLOSE(analytic.Flux(z, 0.1), cumulative.Flux(z, 0.1), 1E-5);
+    }
+}
+
+TEST_FIXTURE(FluxFixture, TestAnalyticCentralTransit)
+{
+    FluxModel analytic(coeffs, 0.001, FluxEngine::analytic);
+    CHECK(!std::isnan(analytic.Flux(0., 0.1)));
+    CHECK_CLOSE(analytic.Flux(0., 0.1), analytic.Flux(1E-4, 0.1), 1E-8);
+}
+
+TEST(TestEngineFromString)
+{
+    CHECK_EQUAL(FluxEngine::FromString(""), FluxEngine::riemann);
+    CHECK_EQUAL(FluxEngine::FromString("Analytic"), FluxEngine::analytic);
+}
+
+
+int main(int argc, const char *argv[])
+{
+    
+    return UnitTest::RunAllTests();
+}
@@ -1,5 +1,84 @@
 #include <UnitTest++/UnitTest++.h>
 #include "Lightcurve.h"
+#include "HostContext.h"
+#include "ScratchArena.h"
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <boost/cstdint.hpp>
+
+namespace
+{
+    /** Allocations made through operator new while counting */
+    long Allocations = 0;
+    bool Counting = false;
+
+    /** Counts every allocation made while it exists */
+    struct AllocationCounter
+    {
+        AllocationCounter()
+        {
+            Allocations = 0;
+            Counting = true;
+        }
+
+        ~AllocationCounter()
+        {
+            Counting = false;
+        }
+
+        long count() const { return Allocations; }
+    };
+
+    /** Host with 10000 evenly spaced points */
+    Lightcurve CountingHost()
+    {
+        const size_t nSamples = 10000;
+        Lightcurve host(nSamples);
+        for (size_t i=0; i<nSamples; ++i)
+        {
+            host.jd[i] = 2454508. + i * 0.01;
+            host.flux[i] = 1000.;
+        }
+
+        host.UpdateValidity();
+        return host;
+    }
+
+    /** Injects the same batch until the arenas have settled, then counts
+     *  the allocations of one more */
+    long SteadyStateAllocations(const Lightcurve &host, const std::vector<Lightcurve> &models)
+    {
+        ScratchArenas scratch(1 << 20);
+        HostContext context(host);
+        std::vector<Lightcurve> outputs;
+        for (int batch=0; batch<2; ++batch)
+        {
+            context.Inject(models, outputs);
+            scratch.Reset();
+        }
+
+        AllocationCounter counter;
+        context.Inject(models, outputs);
+        return counter.count();
+    }
+}
+
+void *operator new(std::size_t bytes)
+{
+    if (Counting)
+        ++Allocations;
+
+    void *memory = malloc(bytes ? bytes : 1);
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) throw()
+{
+    free(memory);
+}
 
 struct BasicFixture
 {
@@ -67,7 +146,111 @@ TEST_FIXTURE(ClearFixture, TestClear)
     CHECK_EQUAL(testlc->size(), 0);
 }
 
+struct ValidityFixture
+{
+    ValidityFixture()
+    {
+        testlc = new Lightcurve(100);
+        for (size_t i=0; i<testlc->size(); ++i)
+        {
+            testlc->flux[i] = (i % 10 == 3) || (i >= 95) ? NAN : 1.;
+        }
+        testlc->UpdateValidity();
+    }
+
+    ~ValidityFixture()
+    {
+        delete testlc;
+    }
+
+    Lightcurve *testlc;
+};
+
+TEST_FIXTURE(ValidityFixture, TestValidCount)
+{
+    CHECK_EQUAL(testlc->nValid(), 85);
+    CHECK(!testlc->valid(3));
+    CHECK(testlc->valid(4));
+}
+
+TEST_FIXTURE(ValidityFixture, TestValidSpans)
+{
+    CHECK_EQUAL(testlc->ValidSpans().size(), 11);
+    CHECK_EQUAL(testlc->ValidSpans().front().second, 3);
+    CHECK_EQUAL(testlc->ValidSpans().back().second, 95);
+}
+
+TEST(TestModelColumns)
+{
+    Lightcurve model(10, Lightcurve::TimeColumn | Lightcurve::FluxColumn);
+    CHECK_EQUAL(model.fluxerr.size(), 0);
+
+    model.Allocate(Lightcurve::ErrorColumn);
+    CHECK(model.allocated(Lightcurve::AllColumns));
+}
+
+TEST(TestColumnAlignment)
+{
+    Lightcurve testlc(7);
+    CHECK_EQUAL(reinterpret_cast<boost::uintptr_t>(&testlc.flux[0]) % 64, 0);
+}
+
+TEST(TestSwap)
+{
+    Lightcurve a(10), b(3);
+    a.period = 2.;
+    a.swap(b);
+    CHECK_EQUAL(a.size(), 3);
+    CHECK_EQUAL(b.size(), 10);
+    CHECK_EQUAL(b.period, 2.);
+}
+
+TEST(TestAssignmentReusesColumns)
+{
+    Lightcurve source(100), target(100);
+    AllocationCounter counter;
+    target = source;
+    CHECK_EQUAL(counter.count(), 0);
+}
+
+TEST(TestInjectReusesColumns)
+{
+    const Lightcurve host = CountingHost();
+
+    /*  models on the host's own time grid are read directly */
+    std::vector<Lightcurve> models(3, host);
+    for (size_t k=0; k<models.size(); ++k)
+    {
+        models[k].period = 86400. * (1. + k);
+        models[k].epoch = 2454508.;
+        models[k].flux.assign(host.size(), 1.);
+    }
+
+    CHECK_EQUAL(SteadyStateAllocations(host, models), 0);
+}
+
+TEST(TestInjectInterpolatedAllocatesNothing)
+{
+    const Lightcurve host = CountingHost();
+
+    /*  models on a phase grid of their own are interpolated */
+    std::vector<Lightcurve> models;
+    for (size_t k=0; k<3; ++k)
+    {
+        Lightcurve model(1000, Lightcurve::TimeColumn | Lightcurve::FluxColumn);
+        model.asWASP = false;
+        model.period = 86400. * (1. + k);
+        model.epoch = 2454508.;
+        for (size_t i=0; i<model.size(); ++i)
+        {
+            model.jd[i] = model.epoch + (i / 1000. - 0.5) * model.period / 86400.;
+            model.flux[i] = 1. - 0.01 * std::exp(-std::pow((i - 500.) / 20., 2));
+        }
+        models.push_back(model);
+    }
 
+    CHECK_EQUAL(SteadyStateAllocations(host, models), 0);
+}
 
 int main(int argc, const char *argv[])
 {
@@ -0,0 +1,141 @@
+#include <UnitTest++/UnitTest++.h>
+#include "Overlay.h"
+#include "AlterTransit.h"
+#include "HostContext.h"
+#include "ModelSampler.h"
+#include "Philox.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <valarray>
+#include <CCfits/CCfits>
+
+namespace
+{
+    const long nFrames = 2000;
+    const unsigned int Seed = 1234;
+    const double Period = 1.09 * 86400.;
+    const double Epoch = 2454508.97605;
+    const double Noise = 0.003;
+    const unsigned int SubModelId = 1000;
+
+    /** Box shaped transit on the data's own time stamps, noise added as
+     *  the model generation does */
+    Lightcurve Model(const Lightcurve &data, double period, double epoch, double depth, unsigned int ModelId)
+    {
+        Lightcurve model(data.size());
+        model.period = period;
+        model.epoch = epoch;
+        model.asWASP = false;
+
+        model.jd.assign(data.jd.begin(), data.jd.end());
+        const std::vector<double> &phase = model.phase();
+
+        const Philox randGenerator(Seed, ModelId);
+        for (size_t i=0; i<data.size(); ++i)
+        {
+            model.flux[i] = std::fabs(phase[i]) < 0.02 ? 1. - depth : 1.;
+            model.flux[i] += Noise * randGenerator.Normal(i);
+        }
+
+        return model;
+    }
+
+    bool SameValue(double a, double b)
+    {
+        return !std::memcmp(&a, &b, sizeof(double));
+    }
+}
+
+TEST(TestOverlayMatchesInjection)
+{
+    const std::string SourceFilename = "TestOverlaySource.fits";
+    const std::string OverlayFilename = "TestOverlay.fits";
+
+    Lightcurve host(nFrames);
+    host.asWASP = false;
+    for (long i=0; i<nFrames; ++i)
+    {
+        host.jd[i] = Epoch - 10. + i * 0.01;
+        host.flux[i] = 1000. + (i % 7);
+        host.fluxerr[i] = 1.;
+    }
+    host.flux[5] = NAN;
+
+    /*  a single host in the source file */
+    {
+        CCfits::FITS source("!" + SourceFilename, CCfits::Write);
+        std::vector<long> naxes(2);
+        naxes[0] = nFrames;
+        naxes[1] = 1;
+
+        std::valarray<double> flux(&host.flux[0], nFrames), fluxerr(&host.fluxerr[0], nFrames), hjd(&host.jd[0], nFrames);
+        source.addImage("HJD", DOUBLE_IMG, naxes)->write(1, nFrames, hjd);
+        source.addImage("FLUX", DOUBLE_IMG, naxes)->write(1, nFrames, flux);
+        source.addImage("FLUXERR", DOUBLE_IMG, naxes)->write(1, nFrames, fluxerr);
+    }
+
+    /*  the full injection, as Application::InjectHost does it */
+    Lightcurve SubModel = Model(host, Period, Epoch, 0.01, SubModelId);
+    host.period = SubModel.period;
+    host.epoch = SubModel.epoch;
+    Lightcurve removed = RemoveTransit(host, SubModel);
+
+    HostContext context(removed);
+    std::vector<Lightcurve> AddModels, synthetics;
+    AddModels.push_back(Model(removed, Period * 1.7, Epoch + 0.3, 0.02, 1));
+    AddModels.push_back(Model(removed, Period * 2.3, Epoch + 0.1, 0.005, 2));
+    context.Inject(AddModels, synthetics);
+
+    {
+        OverlayWriter writer(OverlayFilename, SourceFilename, nFrames, Seed);
+
+        OverlayRecipe recipe;
+        recipe.HostMean = MeanFlux(host);
+        recipe.RemovedMean = context.mean();
+        recipe.SubNoise = Noise;
+        recipe.SubModelId = SubModelId;
+        recipe.AddNoise = Noise;
+        for (size_t k=0; k<synthetics.size(); ++k)
+        {
+            recipe.ModelId = k + 1;
+            writer.Add(0, host, recipe, SubModel, AddModels[k], synthetics[k]);
+        }
+        writer.Flush();
+    }
+
+    OverlayReader reader(OverlayFilename);
+    CHECK_EQUAL(reader.size(), (long)synthetics.size());
+
+    for (size_t k=0; k<synthetics.size(); ++k)
+    {
+        const Lightcurve lc = reader.Read(k);
+        CHECK_EQUAL(reader.HostRow(k), 0);
+
+        long mismatches = 0;
+        for (long i=0; i<nFrames; ++i)
+        {
+            if (!SameValue(lc.flux[i], synthetics[k].flux[i]))
+                ++mismatches;
+        }
+        CHECK_EQUAL(mismatches, 0);
+    }
+
+    /*  only the frames inside the transits are stored */
+    std::vector<std::valarray<int> > DeltaIndex;
+    CCfits::FITS overlay(OverlayFilename, CCfits::Read);
+    overlay.extension("OVERLAY").column("DELTAIDX").readArrays(DeltaIndex, 1, synthetics.size());
+    for (size_t k=0; k<DeltaIndex.size(); ++k)
+    {
+        CHECK(DeltaIndex[k].size() > 0);
+        CHECK(DeltaIndex[k].size() < (size_t)nFrames / 4);
+    }
+
+    std::remove(SourceFilename.c_str());
+    std::remove(OverlayFilename.c_str());
+}
+
+int main(int argc, const char *argv[])
+{
+    return UnitTest::RunAllTests();
+}